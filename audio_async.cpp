@@ -0,0 +1,82 @@
+#include "audio_async.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace {
+
+// converts packets until the conversion ends or has_output reports samples,
+// yielding to the executor between packets
+// a cancelled coroutine is not suspended again (asio would throw at the next
+// co_await), the stop request makes the following packet call the last one
+template<typename Predicate>
+boost::asio::awaitable<std::error_code> convert_packets(audio_demuxer_obj &demuxer, bool &done, Predicate has_output) {
+    auto cancellation = co_await boost::asio::this_coro::cancellation_state;
+    auto executor = co_await boost::asio::this_coro::executor;
+
+    std::error_code result = audio_demuxer_errc::SUCCESS;
+    bool cancelled = false;
+    bool first = true;
+    while (!done && !has_output()) {
+        if (!cancelled && cancellation.cancelled() != boost::asio::cancellation_type::none) {
+            cancelled = true;
+            demuxer.request_stop();
+        }
+        if (!first && !cancelled) {
+            co_await boost::asio::post(executor, boost::asio::use_awaitable);
+        }
+        first = false;
+        result = demuxer.convert_next_packet(done);
+    }
+
+    if (cancelled && result == audio_demuxer_errc::SUCCESS) {
+        result = audio_demuxer_errc::CONVERSION_CANCELLED_ERR;
+    }
+    co_return result;
+}
+
+}
+
+boost::asio::awaitable<std::error_code> async_convert(audio_demuxer_obj &demuxer, audio_sink_obj &sink) {
+    auto result = demuxer.start_conversion(sink);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        co_return result;
+    }
+
+    bool done = false;
+    co_return co_await convert_packets(demuxer, done, []() { return false; });
+}
+
+// audio async reader class
+
+audio_async_reader_obj::audio_async_reader_obj(audio_demuxer_obj &demuxer) :
+        source(demuxer),
+        sink(pending),
+        started(false),
+        done(false) {
+
+}
+
+boost::asio::awaitable<std::error_code> audio_async_reader_obj::next(std::vector<uint8_t> &chunk) {
+    chunk.clear();
+    if (!started) {
+        started = true;
+        auto result = source.start_conversion(sink);
+        if (result != audio_demuxer_errc::SUCCESS) {
+            done = true;
+            co_return result;
+        }
+    }
+    if (done) {
+        co_return audio_demuxer_errc::SUCCESS;
+    }
+
+    auto result = co_await convert_packets(source, done, [this]() { return !pending.empty(); });
+
+    // swapping hands the samples over and keeps the caller's buffer for the next chunk
+    chunk.swap(pending);
+    pending.clear();
+
+    co_return result;
+}
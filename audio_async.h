@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <system_error>
+
+#include <boost/asio/awaitable.hpp>
+
+#include "audio_demuxer.h"
+
+// C++20 coroutine API on Boost.Asio for event-loop services
+// a conversion converts one packet per resumption and posts itself back to its
+// executor in between, so any number of conversions co_spawned on a small pool
+// (e.g. boost::asio::thread_pool) share its threads instead of one thread each
+// cancellation through the coroutine's cancellation slot (terminal by default,
+// e.g. a timer racing it in a parallel group) ends the conversion at the next
+// packet boundary: what was decoded is flushed to the sink and
+// CONVERSION_CANCELLED_ERR is returned
+// demuxing stays blocking, a stalled live input also holds a pool thread
+
+// converts the whole input into the sink, the pipelined mode does not apply
+boost::asio::awaitable<std::error_code> async_convert(audio_demuxer_obj &demuxer, audio_sink_obj &sink);
+
+// async generator of converted PCM: every next call converts packets until
+// some of them produced output and hands it over interleaved, an empty chunk
+// marks the end of the conversion, the demuxer must outlive the reader
+
+class audio_async_reader_obj final {
+public:
+    explicit audio_async_reader_obj(audio_demuxer_obj &demuxer);
+
+    // the chunk's previous buffer is reused for the following chunk
+    boost::asio::awaitable<std::error_code> next(std::vector<uint8_t> &chunk);
+
+private:
+    audio_demuxer_obj                               &source;
+    std::vector<uint8_t>                            pending;
+    audio_memory_sink_obj<std::vector<uint8_t> >    sink;
+    bool                                            started;
+    bool                                            done;
+};
@@ -0,0 +1,174 @@
+#include "audio_batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// summary
+
+double audio_batch_summary::files_per_second() const {
+    return wall_seconds > 0.0 ? static_cast<double>(nb_files) / wall_seconds : 0.0;
+}
+
+double audio_batch_summary::audio_seconds_per_second() const {
+    return wall_seconds > 0.0 ? audio_seconds / wall_seconds : 0.0;
+}
+
+// batch
+
+namespace {
+
+// per-worker job queue, the owner pops from the front and thieves take from the back
+struct job_deque {
+    std::mutex          guard;
+    std::deque<size_t>  items;
+
+    bool pop_front(size_t &item) {
+        std::lock_guard lock(guard);
+        if (items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool steal_back(size_t &item) {
+        std::lock_guard lock(guard);
+        if (items.empty()) {
+            return false;
+        }
+        item = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+audio_batch_obj::audio_batch_obj(int result_sample_rate_hz,
+                                 AVSampleFormat result_format,
+                                 int64_t result_ch_layout,
+                                 unsigned nb_workers,
+                                 const audio_decoder_options &decoder_options) :
+        out_sample_rate_hz(result_sample_rate_hz),
+        out_format(result_format),
+        out_ch_layout(result_ch_layout),
+        workers_amount(nb_workers),
+        decoder_opts(decoder_options),
+        context_pool(nullptr) {
+
+    if (workers_amount == 0) {
+        workers_amount = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    context_pool = std::make_shared<audio_context_pool_obj>(workers_amount);
+}
+
+audio_batch_summary audio_batch_obj::run(const std::vector<audio_batch_job> &jobs,
+                                         std::vector<audio_batch_job_result> &results) const {
+    results.assign(jobs.size(), {});
+
+    // largest inputs first, so long files start early and short ones fill the tail
+    std::vector<std::uintmax_t> sizes(jobs.size(), 0);
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(jobs[i].input, ec);
+        sizes[i] = ec ? 0 : size;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t lhs, size_t rhs) {
+        return sizes[lhs] > sizes[rhs];
+    });
+
+    auto nb_workers = std::min<size_t>(workers_amount, std::max<size_t>(jobs.size(), 1));
+    std::vector<job_deque> queues(nb_workers);
+    for (size_t i = 0; i < order.size(); ++i) {
+        queues[i % nb_workers].items.push_back(order[i]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t worker_id = 0; worker_id < nb_workers; ++worker_id) {
+        workers.emplace_back([&, worker_id]() {
+            while (true) {
+                size_t job_id = 0;
+                auto found = queues[worker_id].pop_front(job_id);
+                for (size_t i = 1; !found && i < nb_workers; ++i) {
+                    found = queues[(worker_id + i) % nb_workers].steal_back(job_id);
+                }
+                if (!found) {
+                    return;
+                }
+                results[job_id] = run_job(jobs[job_id]);
+            }
+        });
+    }
+    for (auto & item : workers) {
+        item.join();
+    }
+
+    audio_batch_summary summary;
+    summary.wall_seconds = seconds_since(start);
+    summary.nb_files = jobs.size();
+    for (auto & item : results) {
+        if (item.error != audio_demuxer_errc::SUCCESS) {
+            ++summary.nb_failed;
+        }
+        summary.audio_seconds += item.audio_seconds;
+    }
+
+    return summary;
+}
+
+std::error_code audio_batch_obj::read_manifest(const std::filesystem::path &manifest_file,
+                                               std::vector<audio_batch_job> &jobs) {
+    std::ifstream in(manifest_file);
+    if (!in.is_open()) {
+        return audio_demuxer_errc::OPEN_SRC_FILE_ERR;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue ;
+        }
+        auto separator = line.find('\t');
+        if (separator == std::string::npos) {
+            return audio_demuxer_errc::WRONG_MANIFEST_LINE_ERR;
+        }
+        jobs.push_back({line.substr(0, separator), line.substr(separator + 1)});
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+// private methods
+
+audio_batch_job_result audio_batch_obj::run_job(const audio_batch_job &job) const {
+    auto start = std::chrono::steady_clock::now();
+
+    auto input = job.input;
+    auto transcoder = audio_demuxer_obj(input,
+                                        out_sample_rate_hz,
+                                        out_format,
+                                        out_ch_layout,
+                                        decoder_opts);
+    transcoder.set_context_pool(context_pool);
+
+    audio_batch_job_result result;
+    result.error = transcoder.convert(job.output);
+    result.audio_seconds = static_cast<double>(transcoder.get_converted_samples()) / out_sample_rate_hz;
+    result.wall_seconds = seconds_since(start);
+
+    return result;
+}
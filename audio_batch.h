@@ -0,0 +1,62 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <system_error>
+
+#include "audio_demuxer.h"
+
+// one (input, output) pair of a batch manifest
+
+struct audio_batch_job {
+    std::filesystem::path   input;
+    std::filesystem::path   output;
+};
+
+struct audio_batch_job_result {
+    std::error_code error;
+    double          audio_seconds = 0.0;
+    double          wall_seconds = 0.0;
+};
+
+struct audio_batch_summary {
+    size_t  nb_files = 0;
+    size_t  nb_failed = 0;
+    double  wall_seconds = 0.0;
+    double  audio_seconds = 0.0;
+
+    double files_per_second() const;
+    double audio_seconds_per_second() const;
+};
+
+// converts many files to the same target format on a fixed-size worker pool
+// jobs are spread over per-worker deques, idle workers steal from the others
+
+class audio_batch_obj final {
+public:
+    audio_batch_obj(int result_sample_rate_hz,
+                    AVSampleFormat result_format,
+                    int64_t result_ch_layout,
+                    unsigned nb_workers = 0,
+                    const audio_decoder_options &decoder_options = {});
+
+    // results are stored in the same order as jobs
+    audio_batch_summary run(const std::vector<audio_batch_job> &jobs,
+                            std::vector<audio_batch_job_result> &results) const;
+
+    // manifest: one job per line, input and output path separated by a tab
+    static std::error_code read_manifest(const std::filesystem::path &manifest_file,
+                                         std::vector<audio_batch_job> &jobs);
+
+private:
+
+    int             out_sample_rate_hz;
+    AVSampleFormat  out_format;
+    std::int64_t    out_ch_layout;
+    unsigned        workers_amount;
+    audio_decoder_options decoder_opts;
+    // decoders and resamplers are reused across the jobs of a batch
+    std::shared_ptr<audio_context_pool_obj> context_pool;
+
+    audio_batch_job_result run_job(const audio_batch_job &job) const;
+};
@@ -0,0 +1,186 @@
+#include "audio_chunker.h"
+#include "audio_demuxer.h"
+
+#include <algorithm>
+#include <cstring>
+
+// public methods
+
+std::unique_ptr<audio_chunker_obj> audio_chunker_obj::create_audio_chunker_obj(const audio_chunk_options &options,
+                                                                               AVSampleFormat sample_fmt,
+                                                                               int nb_channels,
+                                                                               audio_sink_obj &downstream,
+                                                                               std::pmr::memory_resource *resource) {
+    if (options.window_samples <= 0 || options.hop_samples <= 0 || nb_channels <= 0) {
+        return nullptr;
+    }
+    if (av_get_bytes_per_sample(sample_fmt) <= 0) {
+        return nullptr;
+    }
+
+    return std::make_unique<audio_chunker_obj>(options, sample_fmt, nb_channels, downstream, resource);
+}
+
+audio_chunker_obj::audio_chunker_obj(const audio_chunk_options &options,
+                                     AVSampleFormat sample_fmt,
+                                     int nb_channels,
+                                     audio_sink_obj &downstream,
+                                     std::pmr::memory_resource *resource) :
+        window(options.window_samples),
+        hop(options.hop_samples),
+        pad_last(options.pad_last),
+        stride(static_cast<size_t>(av_get_bytes_per_sample(sample_fmt)) *
+               static_cast<size_t>(av_sample_fmt_is_planar(sample_fmt) ? 1 : nb_channels)),
+        silence(av_get_packed_sample_fmt(sample_fmt) == AV_SAMPLE_FMT_U8 ? 0x80 : 0x00),
+        buffers(resource),
+        buffer_start(0),
+        buffer_count(0),
+        skip(0),
+        position(0),
+        covered_end(0),
+        windows(0),
+        sink(downstream) {
+
+    auto nb_planes = static_cast<size_t>(av_sample_fmt_is_planar(sample_fmt) ? nb_channels : 1);
+    buffers.resize(nb_planes);
+    for (auto & item : buffers) {
+        item.resize(2 * static_cast<size_t>(window) * stride);
+    }
+    window_planes.resize(nb_planes);
+}
+
+std::error_code audio_chunker_obj::consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    auto base = position;
+    position += nb_samples;
+
+    int offset = 0;
+    while (true) {
+        // a window that started in an earlier block is completed in the buffer
+        if (buffer_count > 0) {
+            auto take = std::min(window - buffer_count, nb_samples - offset);
+            append(planes, offset, take);
+            offset += take;
+            if (buffer_count < window) {
+                break ;
+            }
+            covered_end = base + offset;
+            auto result = emit_buffer();
+            if (result) {
+                return result;
+            }
+            if (hop < buffer_count) {
+                buffer_start += hop;
+                buffer_count -= hop;
+                // the overlap came from this block only, go back to views
+                if (buffer_count <= offset) {
+                    offset -= buffer_count;
+                    buffer_start = 0;
+                    buffer_count = 0;
+                }
+            } else {
+                skip = hop - buffer_count;
+                buffer_start = 0;
+                buffer_count = 0;
+            }
+            continue;
+        }
+
+        auto skipped = std::min(skip, nb_samples - offset);
+        skip -= skipped;
+        offset += skipped;
+        if (offset == nb_samples) {
+            break ;
+        }
+
+        // whole windows inside the block go out as views
+        if (nb_samples - offset >= window) {
+            covered_end = base + offset + window;
+            auto result = emit(planes, offset);
+            if (result) {
+                return result;
+            }
+            auto left = nb_samples - offset;
+            if (hop > left) {
+                skip = hop - left;
+                offset = nb_samples;
+            } else {
+                offset += hop;
+            }
+            continue;
+        }
+
+        append(planes, offset, nb_samples - offset);
+        break ;
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_chunker_obj::finish() {
+    if (!pad_last || buffer_count == 0 || position <= covered_end) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    compact(window - buffer_count);
+    for (auto & item : buffers) {
+        std::memset(item.data() + static_cast<size_t>(buffer_start + buffer_count) * stride,
+                    silence,
+                    static_cast<size_t>(window - buffer_count) * stride);
+    }
+    buffer_count = window;
+    covered_end = position;
+
+    return emit_buffer();
+}
+
+std::int64_t audio_chunker_obj::get_windows() const {
+    return windows;
+}
+
+// private methods
+
+std::error_code audio_chunker_obj::emit(std::span<const std::span<const uint8_t> > planes, int offset) {
+    for (size_t i = 0; i < window_planes.size(); ++i) {
+        window_planes[i] = planes[i].subspan(static_cast<size_t>(offset) * stride, static_cast<size_t>(window) * stride);
+    }
+    ++windows;
+
+    return sink.consume(window_planes, window);
+}
+
+std::error_code audio_chunker_obj::emit_buffer() {
+    for (size_t i = 0; i < window_planes.size(); ++i) {
+        window_planes[i] = std::span<const uint8_t>(buffers[i].data() + static_cast<size_t>(buffer_start) * stride,
+                                                    static_cast<size_t>(window) * stride);
+    }
+    ++windows;
+
+    return sink.consume(window_planes, window);
+}
+
+void audio_chunker_obj::append(std::span<const std::span<const uint8_t> > planes, int offset, int nb_samples) {
+    if (nb_samples == 0) {
+        return;
+    }
+    compact(nb_samples);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        std::memcpy(buffers[i].data() + static_cast<size_t>(buffer_start + buffer_count) * stride,
+                    planes[i].data() + static_cast<size_t>(offset) * stride,
+                    static_cast<size_t>(nb_samples) * stride);
+    }
+    buffer_count += nb_samples;
+}
+
+void audio_chunker_obj::compact(int nb_samples) {
+    // the retained overlap is shorter than a window, moving it to the front
+    // leaves room for the rest of the next window
+    if (static_cast<size_t>(buffer_start + buffer_count + nb_samples) * stride <= buffers[0].size()) {
+        return;
+    }
+    for (auto & item : buffers) {
+        std::memmove(item.data(),
+                     item.data() + static_cast<size_t>(buffer_start) * stride,
+                     static_cast<size_t>(buffer_count) * stride);
+    }
+    buffer_start = 0;
+}
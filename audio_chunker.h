@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+#include "audio_sink.h"
+
+// fixed-size, optionally overlapping windows for feature extraction, e.g. 25 ms
+// windows with a 10 ms hop (400 / 160 samples at 16 kHz) or 30 s chunks with overlap
+
+struct audio_chunk_options {
+    bool            enabled = false;
+    int             window_samples = 400;   // samples per channel of every window
+    int             hop_samples = 160;      // window start to window start, may exceed the window
+    bool            pad_last = false;       // zero-pad the partial last window instead of dropping it
+};
+
+// re-chunks the converted samples into exact windows, planar formats stay planar
+// windows that lie inside one incoming block are passed on as views of it, only
+// the samples of windows that span two blocks are copied into the internal buffer
+
+class audio_chunker_obj final : public audio_sink_obj {
+public:
+    // nullptr for a non-positive window or hop, the window buffer is allocated from resource
+    static std::unique_ptr<audio_chunker_obj> create_audio_chunker_obj(const audio_chunk_options &options,
+                                                                       AVSampleFormat sample_fmt,
+                                                                       int nb_channels,
+                                                                       audio_sink_obj &downstream,
+                                                                       std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override;
+    // emits the padded partial window when pad_last is set
+    std::error_code finish();
+
+    std::int64_t get_windows() const;
+
+    audio_chunker_obj(const audio_chunk_options &options,
+                      AVSampleFormat sample_fmt,
+                      int nb_channels,
+                      audio_sink_obj &downstream,
+                      std::pmr::memory_resource *resource);
+
+private:
+
+    int                         window;
+    int                         hop;
+    bool                        pad_last;
+    size_t                      stride;         // bytes per sample in one plane
+    uint8_t                     silence;        // byte value of a zero sample
+
+    // per plane, two windows long so a window always fits behind the retained overlap
+    std::pmr::vector<std::pmr::vector<uint8_t> > buffers;
+    int                         buffer_start;   // first retained sample
+    int                         buffer_count;
+    int                         skip;           // input samples between windows when the hop exceeds the window
+
+    // absolute sample positions, finish pads only samples no window covered yet
+    std::int64_t                position;
+    std::int64_t                covered_end;
+
+    std::vector<std::span<const uint8_t> > window_planes;
+    std::int64_t                windows;
+    audio_sink_obj              &sink;
+
+    std::error_code emit(std::span<const std::span<const uint8_t> > planes, int offset);
+    std::error_code emit_buffer();
+    void append(std::span<const std::span<const uint8_t> > planes, int offset, int nb_samples);
+    void compact(int nb_samples);
+};
@@ -0,0 +1,65 @@
+#include "audio_context_pool.h"
+
+audio_context_pool_obj::audio_context_pool_obj(size_t max_idle_per_key) :
+        max_idle(max_idle_per_key) {
+
+}
+
+audio_context_pool_obj::~audio_context_pool_obj() {
+    for (auto & item : idle_decoders) {
+        avcodec_free_context(&item.second);
+    }
+}
+
+AVCodecContext *audio_context_pool_obj::acquire_decoder(const audio_decoder_key &key) {
+    std::lock_guard lock(guard);
+    auto it = idle_decoders.find(key);
+    if (it == idle_decoders.end()) {
+        return nullptr;
+    }
+    auto *decoder_ctx = it->second;
+    idle_decoders.erase(it);
+
+    return decoder_ctx;
+}
+
+void audio_context_pool_obj::release_decoder(const audio_decoder_key &key, AVCodecContext *decoder_ctx) {
+    if (decoder_ctx == nullptr) {
+        return;
+    }
+
+    // drop the state of the previous file
+    avcodec_flush_buffers(decoder_ctx);
+
+    std::unique_lock lock(guard);
+    if (idle_decoders.count(key) >= max_idle) {
+        lock.unlock();
+        avcodec_free_context(&decoder_ctx);
+        return;
+    }
+    idle_decoders.emplace(key, decoder_ctx);
+}
+
+std::unique_ptr<audio_resampler_obj> audio_context_pool_obj::acquire_resampler(const audio_resampler_key &key) {
+    std::lock_guard lock(guard);
+    auto it = idle_resamplers.find(key);
+    if (it == idle_resamplers.end()) {
+        return nullptr;
+    }
+    auto resampler = std::move(it->second);
+    idle_resamplers.erase(it);
+
+    return resampler;
+}
+
+void audio_context_pool_obj::release_resampler(const audio_resampler_key &key, std::unique_ptr<audio_resampler_obj> resampler) {
+    if (resampler == nullptr || resampler->reset() != audio_resampler_err::SUCCESS) {
+        return;
+    }
+
+    std::lock_guard lock(guard);
+    if (idle_resamplers.count(key) >= max_idle) {
+        return;
+    }
+    idle_resamplers.emplace(key, std::move(resampler));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "audio_resampler.h"
+
+// identity of an opened decoder, contexts are only shared between equal keys
+
+struct audio_decoder_key {
+    int             codec_id = 0;
+    int             sample_rate = 0;
+    int             sample_fmt = -1;
+    std::uint64_t   ch_layout = 0;
+    int             channels = 0;
+    std::string     extradata;
+    std::string     decoder_name;
+    int             thread_count = 1;
+    int             thread_type = 0;
+    int             flags = 0;
+    int             skip_frame = 0;
+
+    auto operator<=>(const audio_decoder_key &other) const = default;
+};
+
+// source -> target format of a resampler
+
+struct audio_resampler_key {
+    std::int64_t    src_ch_layout = 0;
+    int             src_rate = 0;
+    int             src_sample_fmt = -1;
+    std::int64_t    dst_ch_layout = 0;
+    int             dst_rate = 0;
+    int             dst_sample_fmt = -1;
+
+    auto operator<=>(const audio_resampler_key &other) const = default;
+};
+
+// thread-safe pool of idle decoder and resampler instances, shared between
+// demuxers (or between the files of one demuxer) to skip avcodec_open2 and
+// swr_init setup on every file
+
+class audio_context_pool_obj final {
+public:
+    explicit audio_context_pool_obj(size_t max_idle_per_key = 4);
+    ~audio_context_pool_obj();
+    // Disallow copying
+    audio_context_pool_obj(audio_context_pool_obj &other) = delete;
+    audio_context_pool_obj &operator=(audio_context_pool_obj &other) = delete;
+
+    // nullptr when no idle instance exists for the key
+    AVCodecContext *acquire_decoder(const audio_decoder_key &key);
+    void release_decoder(const audio_decoder_key &key, AVCodecContext *decoder_ctx);
+
+    std::unique_ptr<audio_resampler_obj> acquire_resampler(const audio_resampler_key &key);
+    void release_resampler(const audio_resampler_key &key, std::unique_ptr<audio_resampler_obj> resampler);
+
+private:
+
+    size_t  max_idle;
+
+    std::mutex                                                              guard;
+    std::multimap<audio_decoder_key, AVCodecContext *>                      idle_decoders;
+    std::multimap<audio_resampler_key, std::unique_ptr<audio_resampler_obj> > idle_resamplers;
+};
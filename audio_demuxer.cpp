@@ -1,6 +1,16 @@
 #include "audio_demuxer.h"
+#include "spsc_queue.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 // error code for audio_demuxer
 
@@ -48,6 +58,28 @@ std::string audio_demuxer_err_category::message(int ev) const {
             return "Send packet to decoder error!";
         case audio_demuxer_errc::RECEIVE_PACKET_FROM_DECODER_ERR:
             return "Receive packet from decoder error!";
+        case audio_demuxer_errc::WRITE_OUTPUT_ERR:
+            return "Could not write converted samples to the output!";
+        case audio_demuxer_errc::ALLOC_IO_CONTEXT_ERR:
+            return "Could not allocate the custom input context!";
+        case audio_demuxer_errc::WRONG_MANIFEST_LINE_ERR:
+            return "Wrong line in the batch manifest!";
+        case audio_demuxer_errc::INIT_DSP_STAGE_ERR:
+            return "Unsupported output format for the processing stage!";
+        case audio_demuxer_errc::INIT_CHUNKER_ERR:
+            return "Wrong chunk window or hop size!";
+        case audio_demuxer_errc::NO_CONVERSION_ERR:
+            return "No conversion was started!";
+        case audio_demuxer_errc::CONVERSION_CANCELLED_ERR:
+            return "The conversion was cancelled!";
+        case audio_demuxer_errc::MEMORY_ADMISSION_ERR:
+            return "The memory budget has no room for the conversion!";
+        case audio_demuxer_errc::MEMORY_LIMIT_ERR:
+            return "The conversion exceeded its memory limit!";
+        case audio_demuxer_errc::SAMPLE_POSITION_ERR:
+            return "Could not place the decoded samples in the stream!";
+        case audio_demuxer_errc::DUPLICATE_STREAM_ERR:
+            return "The same stream was selected twice!";
         default:
             return "(unrecognized error)";
     }
@@ -60,17 +92,48 @@ std::string audio_demuxer_err_category::message(int ev) const {
 audio_demuxer_obj::audio_demuxer_obj(std::filesystem::path &source_filename,
                                      int result_sample_rate_hz,
                                      AVSampleFormat result_format,
-                                     int64_t result_ch_layout) :
+                                     int64_t result_ch_layout,
+                                     const audio_decoder_options &decoder_options) :
         src_filename(source_filename),
         out_sample_rate_hz(result_sample_rate_hz),
         out_format(result_format),
         out_ch_layout(result_ch_layout),
         audio_stream_index(-1),
+        decoder_opts(decoder_options),
         in_fmt_ctx(nullptr),
+        shared_input(false),
+        in_io_ctx(nullptr),
         audio_decoder_ctx(nullptr),
         in_frame(nullptr),
         packet(nullptr),
-        resampler(nullptr) {
+        resampler(nullptr),
+        passthrough(false),
+        input_io_buffer_size(64 * 1024),
+        converted_samples(0),
+        input_duration_sec(0.0),
+        range_start_sample(INT64_MIN),
+        range_end_sample(INT64_MAX),
+        range_preroll_sec(0.5),
+        out_position(0),
+        out_position_known(false),
+        out_position_required(false),
+        packet_pending(false),
+        range_done(false),
+        out_sample_stride(0),
+        seek_index_identified(false),
+        seek_index_preloaded(false),
+        seek_index_loaded(false),
+        seek_index_building(false),
+        seek_index_next_pts(0),
+        seek_index_last_pts(INT64_MIN),
+        conversion_sink(nullptr),
+        conversion_allocations(0),
+        memory_admitted(false),
+        charged_dst_bytes(0),
+        stop_requested(false),
+        next_read_position(0),
+        progress_callback(nullptr),
+        progress_interval(1000) {
 
 }
 
@@ -78,22 +141,71 @@ audio_demuxer_obj::~audio_demuxer_obj() {
     clean_up_resources();
 }
 
-std::error_code audio_demuxer_obj::convert(const std::filesystem::path &output_file) {
-    auto result = get_input_file_info();
+std::error_code audio_demuxer_obj::convert(const std::filesystem::path &output_file,
+                                           const audio_pcm_writer_options &writer_options) {
+    auto writer = audio_pcm_writer_obj::create_audio_pcm_writer_obj(output_file, writer_options);
+    if (writer == nullptr) {
+        return audio_demuxer_errc::OPEN_OUTPUT_FSTREAM_ERR;
+    }
+
+    auto result = convert(*writer);
+    auto finish_result = writer->finish();
     if (result != audio_demuxer_errc::SUCCESS) {
         return result;
     }
 
-    std::fstream fs_out;
-    fs_out.open(output_file, std::ios::out | std::ios::trunc);
-    if (!fs_out.is_open()) {
-        fs_out.clear();
-        return audio_demuxer_errc::OPEN_OUTPUT_FSTREAM_ERR;
+    return finish_result;
+}
+
+std::error_code audio_demuxer_obj::convert(audio_sink_obj &sink) {
+    auto result = start_conversion(sink);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
     }
 
-    in_frame = av_frame_alloc();
-    if (in_frame == nullptr) {
-        return audio_demuxer_errc::ALLOC_IN_FRAME_ERR;
+    // a passthrough has no decode stage to overlap
+    if (pipeline_opts.enabled && !streaming_opts.enabled && !passthrough) {
+        result = run_pipelined(*conversion_sink);
+        AUDIO_STATS_ADD(demuxer_stats.allocations, resampler->get_dst_alloc_count() - conversion_allocations);
+        auto memory_result = check_memory_budget();
+        if (memory_result) {
+            result = memory_result;
+        }
+        return finish_conversion(result);
+    }
+
+    bool done = false;
+    while (!done) {
+        result = convert_next_packet(done);
+    }
+
+    return result;
+}
+
+std::error_code audio_demuxer_obj::start_conversion(audio_sink_obj &sink) {
+    stop_requested = false;
+
+    // a failed start gives the budget reservation back right away
+    auto result = open_conversion(sink);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        release_conversion_state();
+    }
+
+    return result;
+}
+
+std::error_code audio_demuxer_obj::open_conversion(audio_sink_obj &sink) {
+    kept_segments.clear();
+    clean_up_resources();
+
+    auto result = open_stages(sink);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+
+    result = get_input_file_info();
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
     }
 
     packet = av_packet_alloc();
@@ -101,53 +213,424 @@ std::error_code audio_demuxer_obj::convert(const std::filesystem::path &output_f
         return audio_demuxer_errc::ALLOC_PACKET_ERR;
     }
 
-    result = init_resampler();
+    result = open_decoding();
     if (result != audio_demuxer_errc::SUCCESS) {
         return result;
     }
 
-    while (av_read_frame(in_fmt_ctx, packet) >= 0) {
-        if (packet->stream_index == audio_stream_index) {
-            result = decode_packet(packet, fs_out);
+    load_seek_index();
+    seek_to_range_start();
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::open_stages(audio_sink_obj &sink) {
+    // the arena reserves its limit from the shared budget before anything is allocated,
+    // a child conversion takes over the share its parent reserved; either way
+    // the arena returns it to the budget
+    if (memory_opts.conversion_limit_bytes > 0 && memory_admitted) {
+        memory_admitted = false;
+        memory_arena = std::make_shared<audio_memory_arena_obj>(memory_opts.conversion_limit_bytes, memory_opts.budget);
+    } else if (memory_opts.conversion_limit_bytes > 0) {
+        memory_arena = audio_memory_arena_obj::create_audio_memory_arena_obj(memory_opts.conversion_limit_bytes,
+                                                                             memory_opts.budget,
+                                                                             memory_opts.admission_timeout);
+        if (memory_arena == nullptr) {
+            return audio_demuxer_errc::MEMORY_ADMISSION_ERR;
         }
-        av_packet_unref(packet);
-        if (result != audio_demuxer_errc::SUCCESS ) {
-            break ;
+    }
+    auto *resource = memory_arena != nullptr ? memory_arena->get_resource() : std::pmr::get_default_resource();
+    auto nb_channels = av_get_channel_layout_nb_channels(static_cast<uint64_t>(out_ch_layout));
+
+    // stages are chained in front of the sink: resampler -> processing -> chunker -> sink
+    audio_sink_obj *target = &sink;
+
+    if (chunk_opts.enabled) {
+        // the processing stage hands planar output on interleaved
+        auto chunk_format = dsp_opts.enabled ? av_get_packed_sample_fmt(out_format) : out_format;
+        conversion_chunker = audio_chunker_obj::create_audio_chunker_obj(chunk_opts,
+                                                                         chunk_format,
+                                                                         nb_channels,
+                                                                         *target,
+                                                                         resource);
+        if (conversion_chunker == nullptr) {
+            return audio_demuxer_errc::INIT_CHUNKER_ERR;
         }
+        target = conversion_chunker.get();
+    }
+
+    if (dsp_opts.enabled) {
+        conversion_stage = audio_dsp_stage_obj::create_audio_dsp_stage_obj(dsp_opts,
+                                                                          out_sample_rate_hz,
+                                                                          out_format,
+                                                                          nb_channels,
+                                                                          *target,
+                                                                          resource);
+        if (conversion_stage == nullptr) {
+            return audio_demuxer_errc::INIT_DSP_STAGE_ERR;
+        }
+        target = conversion_stage.get();
+    }
+
+    converted_samples = 0;
+    out_position = 0;
+    out_position_known = false;
+    out_position_required = false;
+    range_done = false;
+    latency_histogram.clear();
+    packet_read_marks.clear();
+    next_read_position = 0;
+
+    demuxer_stats = {};
+    last_progress = std::chrono::steady_clock::now();
+    // a failed open releases the conversion state before anything is converted
+    conversion_sink = target;
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::open_decoding() {
+    if (memory_arena != nullptr) {
+        memory_arena->attach_decoder(audio_decoder_ctx);
+    }
+
+    in_frame = av_frame_alloc();
+    if (in_frame == nullptr) {
+        return audio_demuxer_errc::ALLOC_IN_FRAME_ERR;
+    }
+
+    auto result = init_resampler(audio_decoder_ctx);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+    conversion_allocations = resampler->get_dst_alloc_count();
+
+    // raw PCM already in the target format: packet payloads are the output,
+    // planar targets qualify only in mono where they match the packed layout
+    auto *codecpar = in_fmt_ctx->streams[audio_stream_index]->codecpar;
+    passthrough = codecpar->codec_id == av_get_pcm_codec(out_format, -1) &&
+                  (!av_sample_fmt_is_planar(out_format) || audio_decoder_ctx->channels == 1) &&
+                  audio_decoder_ctx->sample_rate == out_sample_rate_hz &&
+                  resampler_key.src_ch_layout == out_ch_layout;
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::convert_next_packet(bool &done) {
+    done = true;
+    if (conversion_sink == nullptr) {
+        return audio_demuxer_errc::NO_CONVERSION_ERR;
+    }
+
+    AUDIO_STATS_START(read_start);
+    auto read_result = read_packet(packet);
+    AUDIO_STATS_STOP(demuxer_stats.read_ns, read_start);
+    if (read_result < 0 || stop_requested) {
+        av_packet_unref(packet);
+        return finish_conversion(flush_conversion(read_result));
+    }
+
+    std::error_code result = audio_demuxer_errc::SUCCESS;
+    if (packet->stream_index == audio_stream_index) {
+        AUDIO_STATS_ADD(demuxer_stats.packets, 1);
+        AUDIO_STATS_ADD(demuxer_stats.bytes_in, packet->size);
+        result = convert_packet(packet);
+    }
+    av_packet_unref(packet);
+    if (result != audio_demuxer_errc::SUCCESS ) {
+        return finish_conversion(result);
+    }
+    if (range_done) {
+        AUDIO_STATS_ADD(demuxer_stats.allocations, resampler->get_dst_alloc_count() - conversion_allocations);
+        return finish_conversion(audio_demuxer_errc::SUCCESS);
+    }
+
+    done = false;
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::convert_packet(const AVPacket *current_packet) {
+    if (streaming_opts.enabled) {
+        mark_packet_read(current_packet);
+    }
+    if (seek_index_building) {
+        add_seek_index_entry(current_packet);
+    }
+    auto result = passthrough ? passthrough_packet(current_packet, *conversion_sink) :
+                                decode_packet(current_packet, *conversion_sink);
+
+    // a frame allocation refused by the arena surfaces as a decoder error
+    auto memory_result = check_memory_budget();
+    if (memory_result) {
+        result = memory_result;
+    }
+
+    return result;
+}
+
+std::error_code audio_demuxer_obj::convert(std::vector<uint8_t> &output) {
+    audio_memory_sink_obj sink(output);
+    return convert(sink);
+}
+
+std::error_code audio_demuxer_obj::convert(std::pmr::vector<uint8_t> &output) {
+    audio_memory_sink_obj sink(output);
+    return convert(sink);
+}
+
+std::error_code audio_demuxer_obj::convert(audio_ring_buffer_obj &output) {
+    auto result = convert(static_cast<audio_sink_obj &>(output));
+    output.close();
+    return result;
+}
+
+void audio_demuxer_obj::set_source(const std::filesystem::path &source_filename) {
+    src_filename = source_filename;
+    input_source = nullptr;
+}
+
+void audio_demuxer_obj::set_source(std::shared_ptr<audio_input_source_obj> source, int io_buffer_size) {
+    input_source = std::move(source);
+    input_io_buffer_size = io_buffer_size;
+}
+
+void audio_demuxer_obj::set_probe_options(const audio_probe_options &options) {
+    probe_opts = options;
+}
+
+void audio_demuxer_obj::set_context_pool(std::shared_ptr<audio_context_pool_obj> pool) {
+    clean_up_resources();
+    context_pool = std::move(pool);
+}
+
+void audio_demuxer_obj::set_time_range(double start_sec, double duration_sec) {
+    range_start_sample = INT64_MIN;
+    range_end_sample = INT64_MAX;
+    if (start_sec > 0.0) {
+        range_start_sample = std::llround(start_sec * out_sample_rate_hz);
+    }
+    if (duration_sec > 0.0) {
+        range_end_sample = std::max<int64_t>(range_start_sample, 0) + std::llround(duration_sec * out_sample_rate_hz);
+    }
+}
+
+void audio_demuxer_obj::set_seek_index_file(const std::filesystem::path &sidecar_file) {
+    seek_index_file = sidecar_file;
+    seek_index_identified = false;
+    seek_index_preloaded = false;
+    seek_index_loaded = false;
+    seek_index.clear();
+}
+
+void audio_demuxer_obj::set_dsp_options(const audio_dsp_options &options) {
+    dsp_opts = options;
+}
+
+void audio_demuxer_obj::set_chunk_options(const audio_chunk_options &options) {
+    chunk_opts = options;
+}
+
+void audio_demuxer_obj::set_memory_options(const audio_memory_options &options) {
+    memory_opts = options;
+}
+
+const std::vector<audio_kept_segment> &audio_demuxer_obj::get_kept_segments() const {
+    return kept_segments;
+}
+
+void audio_demuxer_obj::set_pipeline_options(const audio_pipeline_options &options) {
+    pipeline_opts = options;
+}
+
+void audio_demuxer_obj::set_streaming_options(const audio_streaming_options &options) {
+    streaming_opts = options;
+}
+
+const audio_latency_histogram &audio_demuxer_obj::get_latency_histogram() const {
+    return latency_histogram;
+}
+
+void audio_demuxer_obj::request_stop() {
+    stop_requested = true;
+}
+
+const audio_pipeline_stats &audio_demuxer_obj::get_pipeline_stats() const {
+    return pipeline_stats;
+}
+
+std::uint64_t audio_demuxer_obj::get_converted_samples() const {
+    return converted_samples;
+}
+
+const audio_demuxer_stats &audio_demuxer_obj::get_stats() const {
+    return demuxer_stats;
+}
+
+bool audio_demuxer_obj::is_passthrough() const {
+    return passthrough;
+}
+
+void audio_demuxer_obj::set_progress_callback(audio_progress_callback callback,
+                                              std::chrono::milliseconds interval) {
+    progress_callback = std::move(callback);
+    progress_interval = interval;
+}
+
+std::error_code audio_demuxer_obj::convert_segmented(const std::filesystem::path &output_file,
+                                                     unsigned nb_segments,
+                                                     const audio_pcm_writer_options &writer_options) {
+    stop_requested = false;
+    converted_samples = 0;
+    clean_up_resources();
+    auto result = get_input_file_info();
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+    // the conversion below starts a new call, a stop requested while probing ends it here
+    if (stop_requested) {
+        clean_up_resources();
+        return audio_demuxer_errc::SUCCESS;
+    }
+    auto duration = input_duration_sec;
+    // every segment opens its own contexts
+    clean_up_resources();
+
+    if (nb_segments == 0) {
+        nb_segments = std::max(std::thread::hardware_concurrency(), 1U);
     }
+    auto max_segments = static_cast<unsigned>(duration / min_segment_sec);
+    nb_segments = std::min(nb_segments, max_segments);
+    // every segment needs its own reader over the input, a user time range is
+    // decoded serially
+    auto cloneable = input_source == nullptr || input_source->clone() != nullptr;
+    auto whole_stream = range_start_sample == INT64_MIN && range_end_sample == INT64_MAX;
+    // segments write at fixed byte offsets, which needs a fixed size per sample
+    auto positional = writer_options.layout == audio_output_layout::interleaved ||
+                      (writer_options.layout == audio_output_layout::block_planar && !av_sample_fmt_is_planar(out_format));
+    if (nb_segments <= 1 || !cloneable || !whole_stream || !positional) {
+        return convert(output_file, writer_options);
+    }
+
+    // segment boundaries in output samples, the last segment runs to the end of the stream
+    auto total_samples = static_cast<int64_t>(duration * out_sample_rate_hz);
+    auto nb_channels = av_get_channel_layout_nb_channels(static_cast<uint64_t>(out_ch_layout));
+    auto frame_size = static_cast<std::uint64_t>(av_get_bytes_per_sample(out_format)) * static_cast<std::uint64_t>(nb_channels);
+    auto segment_start = [&](unsigned i) { return total_samples * i / nb_segments; };
+
+    auto output_fd = open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output_fd < 0) {
+        return audio_demuxer_errc::OPEN_OUTPUT_FSTREAM_ERR;
+    }
+    auto segment_options = writer_options;
+    segment_options.layout = audio_output_layout::interleaved;
+    segment_options.direct_io = false;
+
+    std::vector<std::error_code> errors(nb_segments);
+    std::vector<std::uint64_t> samples(nb_segments, 0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < nb_segments; ++i) {
+        workers.emplace_back([&, i]() {
+            auto input = src_filename;
+            auto segment = audio_demuxer_obj(input, out_sample_rate_hz, out_format, out_ch_layout, decoder_opts);
+            if (input_source != nullptr) {
+                segment.set_source(input_source->clone(), input_io_buffer_size);
+            }
+            segment.set_probe_options(probe_opts);
+            segment.set_context_pool(context_pool);
+            segment.set_seek_index_file(seek_index_file);
+            // the first segment drops what lies before the stream start, so the
+            // file offset of every sample is its position times the frame size
+            auto start = segment_start(i);
+            auto end = i + 1 == nb_segments ? INT64_MAX : segment_start(i + 1);
+            segment.range_start_sample = start;
+            segment.range_end_sample = end;
 
-    auto flash_result = decode_packet(nullptr, fs_out);
-    if (flash_result != audio_demuxer_errc::SUCCESS) {
-        return flash_result;
+            auto writer = audio_pcm_writer_obj::create_audio_pcm_writer_obj(output_fd,
+                                                                           static_cast<std::uint64_t>(start) * frame_size,
+                                                                           segment_options);
+            if (writer == nullptr) {
+                errors[i] = audio_demuxer_errc::OPEN_OUTPUT_FSTREAM_ERR;
+                return;
+            }
+            errors[i] = segment.convert(*writer);
+            auto finish_result = writer->finish();
+            if (errors[i] == audio_demuxer_errc::SUCCESS) {
+                errors[i] = finish_result;
+            }
+            samples[i] = segment.get_converted_samples();
+            // a segment that did not fill its range would leave a gap before the next one
+            if (errors[i] == audio_demuxer_errc::SUCCESS && end != INT64_MAX &&
+                samples[i] != static_cast<std::uint64_t>(end - start)) {
+                errors[i] = audio_demuxer_errc::SAMPLE_POSITION_ERR;
+            }
+        });
     }
+    for (auto & item : workers) {
+        item.join();
+    }
+    ::close(output_fd);
 
-    fs_out.clear();
-    fs_out.close();
+    converted_samples = 0;
+    for (unsigned i = 0; i < nb_segments; ++i) {
+        if (errors[i] == audio_demuxer_errc::SAMPLE_POSITION_ERR) {
+            return convert(output_file, writer_options);
+        }
+    }
+    for (unsigned i = 0; i < nb_segments; ++i) {
+        if (errors[i] != audio_demuxer_errc::SUCCESS) {
+            return errors[i];
+        }
+        converted_samples += samples[i];
+    }
 
     return audio_demuxer_errc::SUCCESS;
 }
 
+double audio_demuxer_obj::get_input_duration() const {
+    return input_duration_sec;
+}
+
 // private methods
 
 void audio_demuxer_obj::clean_up_resources() {
+    release_conversion_state();
     if (audio_decoder_ctx != nullptr) {
-        avcodec_free_context(&audio_decoder_ctx);
+        context_pool->release_decoder(decoder_key, audio_decoder_ctx);
+        audio_decoder_ctx = nullptr;
+    }
+    if (resampler != nullptr) {
+        context_pool->release_resampler(resampler_key, std::move(resampler));
+        resampler = nullptr;
+    }
+    // a shared input is closed by the demuxer that opened it
+    if (shared_input) {
+        in_fmt_ctx = nullptr;
+        shared_input = false;
     }
     if (in_fmt_ctx != nullptr) {
         avformat_close_input(&in_fmt_ctx);
     }
+    // custom IO is not owned by the format context, the buffer may have been reallocated by avio
+    if (in_io_ctx != nullptr) {
+        av_freep(&in_io_ctx->buffer);
+        avio_context_free(&in_io_ctx);
+    }
     if (in_frame != nullptr) {
         av_frame_free(&in_frame);
     }
     if (packet != nullptr) {
         av_packet_free(&packet);
     }
+    packet_pending = false;
 }
 
-std::error_code audio_demuxer_obj::open_codec_context(enum AVMediaType type) {
+std::error_code audio_demuxer_obj::open_codec_context(int stream_index) {
 
-    audio_stream_index = av_find_best_stream(in_fmt_ctx, type, -1, -1, nullptr, 0);
+    audio_stream_index = stream_index;
     if (audio_stream_index < 0) {
+        audio_stream_index = av_find_best_stream(in_fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    }
+    if (audio_stream_index < 0 || audio_stream_index >= static_cast<int>(in_fmt_ctx->nb_streams)) {
         return audio_demuxer_errc::FIND_INPUT_STREAM_ERR;
     } else {
         if (in_fmt_ctx->streams[audio_stream_index] == nullptr) {
@@ -155,21 +638,64 @@ std::error_code audio_demuxer_obj::open_codec_context(enum AVMediaType type) {
         }
     }
 
-    const AVCodec *decoder = avcodec_find_decoder(in_fmt_ctx->streams[audio_stream_index]->codecpar->codec_id);
+    const AVCodec *decoder = nullptr;
+    if (decoder_opts.decoder_name.empty()) {
+        decoder = avcodec_find_decoder(in_fmt_ctx->streams[audio_stream_index]->codecpar->codec_id);
+    } else {
+        decoder = avcodec_find_decoder_by_name(decoder_opts.decoder_name.c_str());
+    }
     if (decoder == nullptr) {
         return audio_demuxer_errc::FIND_DECODER_ERR;
     }
 
+    auto *codecpar = in_fmt_ctx->streams[audio_stream_index]->codecpar;
+    decoder_key = {};
+    decoder_key.codec_id = codecpar->codec_id;
+    decoder_key.sample_rate = codecpar->sample_rate;
+    decoder_key.sample_fmt = codecpar->format;
+    decoder_key.ch_layout = codecpar->channel_layout;
+    decoder_key.channels = codecpar->channels;
+    if (codecpar->extradata != nullptr) {
+        decoder_key.extradata.assign(reinterpret_cast<const char *>(codecpar->extradata),
+                                     static_cast<size_t>(codecpar->extradata_size));
+    }
+    decoder_key.decoder_name = decoder->name;
+    // frame threading delays the output by one frame per thread
+    auto thread_count = streaming_opts.enabled ? 1 : decoder_opts.thread_count;
+    auto low_delay = decoder_opts.low_delay || streaming_opts.enabled;
+    decoder_key.thread_count = thread_count;
+    decoder_key.thread_type = decoder_opts.thread_type;
+    decoder_key.flags = low_delay ? AV_CODEC_FLAG_LOW_DELAY : 0;
+    decoder_key.skip_frame = decoder_opts.skip_frame;
+
+    if (context_pool == nullptr) {
+        context_pool = std::make_shared<audio_context_pool_obj>();
+    }
+    audio_decoder_ctx = context_pool->acquire_decoder(decoder_key);
+    if (audio_decoder_ctx != nullptr) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+
     audio_decoder_ctx = avcodec_alloc_context3(decoder);
     if (audio_decoder_ctx == nullptr) {
         return audio_demuxer_errc::ALLOC_CODEC_ERR;
     }
 
-    if (avcodec_parameters_to_context(audio_decoder_ctx, in_fmt_ctx->streams[audio_stream_index]->codecpar) < 0) {
+    // a context that failed to open must not end up in the pool
+    if (avcodec_parameters_to_context(audio_decoder_ctx, codecpar) < 0) {
+        avcodec_free_context(&audio_decoder_ctx);
         return audio_demuxer_errc::COPY_CODEC_PARAMS_ERR;
     }
 
+    audio_decoder_ctx->thread_count = thread_count;
+    audio_decoder_ctx->thread_type = decoder_opts.thread_type;
+    audio_decoder_ctx->skip_frame = decoder_opts.skip_frame;
+    if (low_delay) {
+        audio_decoder_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+
     if (avcodec_open2(audio_decoder_ctx, decoder, nullptr) < 0) {
+        avcodec_free_context(&audio_decoder_ctx);
         return audio_demuxer_errc::INIT_DECODER_ERR;
     }
 
@@ -177,14 +703,84 @@ std::error_code audio_demuxer_obj::open_codec_context(enum AVMediaType type) {
 
 }
 
+namespace {
+
+std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+int interrupt_input(void *opaque) {
+    return static_cast<std::atomic<bool> *>(opaque)->load() ? 1 : 0;
+}
+
+}
+
 std::error_code audio_demuxer_obj::get_input_file_info() {
+    const AVInputFormat *input_format = nullptr;
+    if (!probe_opts.format_name.empty()) {
+        input_format = av_find_input_format(probe_opts.format_name.c_str());
+        if (input_format == nullptr) {
+            return audio_demuxer_errc::OPEN_SRC_FILE_ERR;
+        }
+    }
+
+    // streaming mode probes as little as the stream allows, explicit probe options win
+    auto probesize = probe_opts.probesize;
+    auto analyzeduration = probe_opts.analyzeduration;
+    if (streaming_opts.enabled) {
+        probesize = probesize > 0 ? probesize : streaming_opts.probesize;
+        analyzeduration = analyzeduration > 0 ? analyzeduration : streaming_opts.analyzeduration;
+    }
+    // a file indexed by an earlier full pass was probed then, only the codec
+    // parameters are needed; the full probe would read as far as it did the
+    // first time, which is what the index is there to avoid
+    if (preload_seek_index()) {
+        probesize = probesize > 0 ? probesize : seek_index_probesize;
+        analyzeduration = analyzeduration > 0 ? analyzeduration : seek_index_analyzeduration;
+    }
+
+    AVDictionary *format_options = nullptr;
+    if (probesize > 0) {
+        av_dict_set_int(&format_options, "probesize", probesize, 0);
+    }
+    if (analyzeduration > 0) {
+        av_dict_set_int(&format_options, "analyzeduration", analyzeduration, 0);
+    }
+    if (streaming_opts.enabled && streaming_opts.nobuffer) {
+        av_dict_set(&format_options, "fflags", "nobuffer", 0);
+    }
+
+    const char *url = src_filename.c_str();
+    if (input_source != nullptr) {
+        auto result = open_custom_io();
+        if (result != audio_demuxer_errc::SUCCESS) {
+            av_dict_free(&format_options);
+            return result;
+        }
+        url = nullptr;
+    } else {
+        if (streaming_opts.enabled && streaming_opts.direct_io) {
+            av_dict_set(&format_options, "avioflags", "direct", 0);
+        }
+        in_fmt_ctx = avformat_alloc_context();
+        if (in_fmt_ctx == nullptr) {
+            av_dict_free(&format_options);
+            return audio_demuxer_errc::OPEN_SRC_FILE_ERR;
+        }
+    }
+    // lets request_stop interrupt a read blocked on a live input
+    in_fmt_ctx->interrupt_callback.callback = interrupt_input;
+    in_fmt_ctx->interrupt_callback.opaque = &stop_requested;
 
-    if (avformat_open_input(&in_fmt_ctx, src_filename.c_str(), nullptr, nullptr) < 0) {
+    auto open_result = avformat_open_input(&in_fmt_ctx, url, input_format, &format_options);
+    av_dict_free(&format_options);
+    if (open_result < 0) {
         clean_up_resources();
         return audio_demuxer_errc::OPEN_SRC_FILE_ERR;
     }
 
-    if (avformat_find_stream_info(in_fmt_ctx, nullptr) < 0) {
+    if (!probe_opts.skip_find_stream_info && avformat_find_stream_info(in_fmt_ctx, nullptr) < 0) {
         clean_up_resources();
         return audio_demuxer_errc::GET_STREAM_INFO_ERR;
     }
@@ -194,72 +790,1353 @@ std::error_code audio_demuxer_obj::get_input_file_info() {
         return result;
     }
 
+    // duration of the selected stream, the container one is used as a fallback
+    auto *stream = in_fmt_ctx->streams[audio_stream_index];
+    if (stream->duration != AV_NOPTS_VALUE && stream->duration > 0) {
+        input_duration_sec = static_cast<double>(stream->duration) * av_q2d(stream->time_base);
+    } else if (in_fmt_ctx->duration != AV_NOPTS_VALUE && in_fmt_ctx->duration > 0) {
+        input_duration_sec = static_cast<double>(in_fmt_ctx->duration) / AV_TIME_BASE;
+    } else {
+        input_duration_sec = 0.0;
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+namespace {
+
+int read_input_source(void *opaque, uint8_t *buf, int buf_size) {
+    return static_cast<audio_input_source_obj *>(opaque)->read(buf, buf_size);
+}
+
+int64_t seek_input_source(void *opaque, int64_t offset, int whence) {
+    return static_cast<audio_input_source_obj *>(opaque)->seek(offset, whence);
+}
+
+}
+
+std::error_code audio_demuxer_obj::open_custom_io() {
+    in_fmt_ctx = avformat_alloc_context();
+    if (in_fmt_ctx == nullptr) {
+        return audio_demuxer_errc::ALLOC_IO_CONTEXT_ERR;
+    }
+
+    auto *io_buffer = static_cast<unsigned char *>(av_malloc(static_cast<size_t>(input_io_buffer_size)));
+    if (io_buffer == nullptr) {
+        clean_up_resources();
+        return audio_demuxer_errc::ALLOC_IO_CONTEXT_ERR;
+    }
+
+    in_io_ctx = avio_alloc_context(io_buffer,
+                                   input_io_buffer_size,
+                                   0,
+                                   input_source.get(),
+                                   read_input_source,
+                                   nullptr,
+                                   input_source->is_seekable() ? seek_input_source : nullptr);
+    if (in_io_ctx == nullptr) {
+        av_free(io_buffer);
+        clean_up_resources();
+        return audio_demuxer_errc::ALLOC_IO_CONTEXT_ERR;
+    }
+
+    // rewind, the same source may be converted again
+    if (input_source->is_seekable()) {
+        input_source->seek(0, SEEK_SET);
+    }
+
+    in_fmt_ctx->pb = in_io_ctx;
+    in_fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
     return audio_demuxer_errc::SUCCESS;
 }
 
-std::error_code audio_demuxer_obj::init_resampler() {
+std::error_code audio_demuxer_obj::init_resampler(const AVCodecContext *source_ctx) {
 
     int64_t tmp = 0;
-    if (audio_decoder_ctx->channel_layout == 0) {
-        tmp = av_get_default_channel_layout(audio_decoder_ctx->channels);
+    if (source_ctx->channel_layout == 0) {
+        tmp = av_get_default_channel_layout(source_ctx->channels);
     } else {
-        if (audio_decoder_ctx->channel_layout < INT64_MAX) {
-            tmp = static_cast<int64_t>(audio_decoder_ctx->channel_layout);
+        if (source_ctx->channel_layout < INT64_MAX) {
+            tmp = static_cast<int64_t>(source_ctx->channel_layout);
         }
     }
     if (tmp == 0) {
         return audio_demuxer_errc::WRONG_INIT_DATA_FOR_RESAMPLER;
     }
 
-    auto tmp_resampler = audio_resampler_obj::create_audio_resampler_obj(tmp,
-                                                                         audio_decoder_ctx->sample_rate,
-                                                                         audio_decoder_ctx->sample_fmt,
-                                                                         out_ch_layout,
-                                                                         out_sample_rate_hz,
-                                                                         out_format);
+    resampler_key = {tmp,
+                     source_ctx->sample_rate,
+                     source_ctx->sample_fmt,
+                     out_ch_layout,
+                     out_sample_rate_hz,
+                     out_format};
+    auto tmp_resampler = context_pool->acquire_resampler(resampler_key);
+    if (tmp_resampler == nullptr) {
+        tmp_resampler = audio_resampler_obj::create_audio_resampler_obj(tmp,
+                                                                        source_ctx->sample_rate,
+                                                                        source_ctx->sample_fmt,
+                                                                        out_ch_layout,
+                                                                        out_sample_rate_hz,
+                                                                        out_format);
+    }
     if (tmp_resampler == nullptr) {
         return audio_demuxer_errc::INIT_RESAMPLER_ERR;
     }
 
     resampler = std::move(tmp_resampler);
 
+    // bytes per sample in one output plane, used to trim output to the requested range
+    out_sample_stride = av_get_bytes_per_sample(out_format);
+    if (!av_sample_fmt_is_planar(out_format)) {
+        out_sample_stride *= av_get_channel_layout_nb_channels(static_cast<std::uint64_t>(out_ch_layout));
+    }
+    trimmed_planes.resize(resampler->get_output_planes().size());
+
     return audio_demuxer_errc::SUCCESS;
 }
 
-std::error_code audio_demuxer_obj::decode_packet(const AVPacket *current_packet, std::fstream &out_stream) {
-    auto result = avcodec_send_packet(audio_decoder_ctx, current_packet);
-    if (result < 0) {
-        return audio_demuxer_errc::SEND_PACKET_TO_DECODER_ERR;
+bool audio_demuxer_obj::preload_seek_index() {
+    seek_index_identified = false;
+    seek_index_preloaded = false;
+    if (seek_index_file.empty() || input_source != nullptr) {
+        return false;
+    }
+    if (!audio_seek_index_obj::get_file_identity(src_filename, seek_index_identity)) {
+        return false;
     }
+    seek_index_identified = true;
 
-    while (true) {
-        result = avcodec_receive_frame(audio_decoder_ctx, in_frame);
-        if (result < 0) {
-            if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) {
-                break ;
-            }
-            return audio_demuxer_errc::RECEIVE_PACKET_FROM_DECODER_ERR;
-        }
+    // a sidecar of another file version fails the identity check
+    seek_index_preloaded = seek_index.load(seek_index_file, seek_index_identity);
+    return seek_index_preloaded;
+}
 
-        std::vector<std::vector<uint8_t> > tmp_storage;
-        auto convert_result = resampler->convert(in_frame, tmp_storage);
-        av_frame_unref(in_frame);
-        if (convert_result != audio_resampler_err::SUCCESS) {
-            return audio_demuxer_errc::CONVERT_SAMPLES_ERR;
-        }
+void audio_demuxer_obj::load_seek_index() {
+    seek_index_loaded = false;
+    seek_index_building = false;
+    if (!seek_index_identified) {
+        return;
+    }
+
+    // the sidecar was read by get_input_file_info, the stream is known now
+    auto *stream = in_fmt_ctx->streams[audio_stream_index];
+    seek_index_loaded = seek_index_preloaded &&
+                        seek_index.matches(audio_stream_index, stream->time_base.num, stream->time_base.den);
+    if (seek_index_loaded) {
+        return;
+    }
 
-        output_data(out_stream, tmp_storage, resampler->get_output_buf_size());
+    // the index is built by a serial pass from the stream start only, the
+    // pipelined demux thread and ranged passes skip it
+    seek_index.clear();
+    seek_index_preloaded = false;
+    seek_index.set_stream(audio_stream_index, stream->time_base.num, stream->time_base.den);
+    seek_index_next_pts = 0;
+    seek_index_last_pts = INT64_MIN;
+    seek_index_building = range_start_sample <= 0 && range_end_sample == INT64_MAX && !pipeline_opts.enabled;
+}
 
+void audio_demuxer_obj::add_seek_index_entry(const AVPacket *current_packet) {
+    if (current_packet->pos < 0) {
+        return;
     }
 
-    return audio_demuxer_errc::SUCCESS;
+    // pts from the stream start, packets without one continue the durations
+    auto *stream = in_fmt_ctx->streams[audio_stream_index];
+    auto stream_start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    auto pts = current_packet->pts != AV_NOPTS_VALUE ? current_packet->pts - stream_start : seek_index_next_pts;
+    seek_index_next_pts = pts + current_packet->duration;
+
+    auto interval = av_rescale_q(seek_index_interval_ms, av_make_q(1, 1000), stream->time_base);
+    if (seek_index_last_pts != INT64_MIN && pts - seek_index_last_pts < std::max<int64_t>(interval, 1)) {
+        return;
+    }
+    seek_index.add(pts, current_packet->pos);
+    seek_index_last_pts = pts;
 }
 
-void audio_demuxer_obj::output_data(std::fstream &out_fs,
-                                    std::vector<std::vector<uint8_t>> &data_storage,
-                                    int data_size) {
-    for (auto & item : data_storage) {
-        out_fs.write(reinterpret_cast<const char *>(item.data()), data_size);
+bool audio_demuxer_obj::seek_by_index(int64_t target_sample) {
+    auto *stream = in_fmt_ctx->streams[audio_stream_index];
+    auto target = av_rescale_q(target_sample, av_make_q(1, out_sample_rate_hz), stream->time_base);
+
+    audio_seek_index_entry entry {};
+    if (!seek_index.find(target, entry)) {
+        return false;
+    }
+    if (av_seek_frame(in_fmt_ctx, audio_stream_index, entry.pos, AVSEEK_FLAG_BYTE) < 0) {
+        return false;
+    }
+
+    // reading no longer starts at the stream start, even if the fallback fails
+    out_position_required = true;
+
+    // demuxers may resume elsewhere after a byte seek (Matroska at the next
+    // cluster, MP3 at the next frame header), the first packet shows where;
+    // anywhere but the indexed packet falls back to the container's seek
+    auto stream_start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    if (av_read_frame(in_fmt_ctx, packet) < 0) {
+        return false;
+    }
+    auto at_entry = packet->stream_index == audio_stream_index &&
+                    (packet->pos == entry.pos ||
+                     (packet->pts != AV_NOPTS_VALUE && packet->pts - stream_start == entry.pts));
+    if (!at_entry) {
+        av_packet_unref(packet);
+        return false;
+    }
+    avcodec_flush_buffers(audio_decoder_ctx);
+
+    // byte seeks leave the packet pts to the demuxer's estimate, the indexed pts
+    // goes to the decoder with the packet; the output position is taken from
+    // the first frame's pts, which also accounts for the priming samples a
+    // decoder drops after the flush
+    if (packet->pos == entry.pos) {
+        packet->pts = entry.pts + stream_start;
+        packet->dts = packet->pts;
+    }
+    packet_pending = true;
+
+    return true;
+}
+
+int audio_demuxer_obj::read_packet(AVPacket *target) {
+    if (packet_pending) {
+        packet_pending = false;
+        if (target != packet) {
+            av_packet_move_ref(target, packet);
+        }
+        return 0;
+    }
+
+    return av_read_frame(in_fmt_ctx, target);
+}
+
+void audio_demuxer_obj::seek_to_range_start() {
+    if (range_start_sample <= 0) {
+        return;
+    }
+
+    // start a bit earlier so the decoder and the resampler are warmed up at the
+    // first kept sample, everything before the range start is trimmed by pts
+    auto *stream = in_fmt_ctx->streams[audio_stream_index];
+    auto stream_start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    auto preroll_samples = static_cast<int64_t>(range_preroll_sec * out_sample_rate_hz);
+    auto target_sample = std::max<int64_t>(range_start_sample - preroll_samples, 0);
+    if (seek_index_loaded && seek_by_index(target_sample)) {
+        return;
+    }
+    auto target = av_rescale_q(target_sample,
+                               av_make_q(1, out_sample_rate_hz),
+                               stream->time_base) + stream_start;
+
+    // closest seek point at or before the target, on failure decoding starts
+    // from the beginning and the result is the same
+    if (avformat_seek_file(in_fmt_ctx, audio_stream_index, INT64_MIN, target, target, 0) >= 0) {
+        avcodec_flush_buffers(audio_decoder_ctx);
+        out_position_required = true;
+    }
+}
+
+std::error_code audio_demuxer_obj::output_samples(int64_t frame_pts,
+                                                  std::span<const std::span<const uint8_t> > planes,
+                                                  int64_t nb_samples,
+                                                  audio_sink_obj &sink) {
+    // output position of the first converted frame comes from its pts, later
+    // frames continue the count so the output stays gapless
+    if (!out_position_known) {
+        // counting from 0 is only right when decoding started at the stream start
+        if (frame_pts == AV_NOPTS_VALUE && out_position_required) {
+            return audio_demuxer_errc::SAMPLE_POSITION_ERR;
+        }
+        out_position_known = true;
+        if (frame_pts != AV_NOPTS_VALUE) {
+            auto *stream = in_fmt_ctx->streams[audio_stream_index];
+            auto stream_start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+            out_position = av_rescale_q(frame_pts - stream_start,
+                                        stream->time_base,
+                                        av_make_q(1, out_sample_rate_hz));
+        }
+    }
+
+    auto begin = out_position;
+    out_position += nb_samples;
+    if (out_position >= range_end_sample) {
+        range_done = true;
+    }
+
+    // compared before subtracting, the open range ends are INT64_MIN / INT64_MAX
+    auto keep_from = range_start_sample <= begin ? 0 : std::min(range_start_sample - begin, nb_samples);
+    auto keep_to = range_end_sample >= out_position ? nb_samples : std::max<int64_t>(range_end_sample - begin, 0);
+    if (keep_to <= keep_from) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    if (keep_from > 0 || keep_to < nb_samples) {
+        for (size_t i = 0; i < planes.size(); ++i) {
+            trimmed_planes[i] = planes[i].subspan(static_cast<size_t>(keep_from * out_sample_stride),
+                                                  static_cast<size_t>((keep_to - keep_from) * out_sample_stride));
+        }
+        planes = trimmed_planes;
+    }
+
+    auto nb_kept = static_cast<int>(keep_to - keep_from);
+    AUDIO_STATS_START(output_start);
+    auto result = sink.consume(planes, nb_kept);
+    AUDIO_STATS_STOP(demuxer_stats.output_ns, output_start);
+    if (result) {
+        return result;
+    }
+    converted_samples += static_cast<std::uint64_t>(nb_kept);
+    if (streaming_opts.enabled) {
+        record_latency(begin + keep_from);
+    }
+    AUDIO_STATS_ADD(demuxer_stats.samples_out, nb_kept);
+    AUDIO_STATS_ADD(demuxer_stats.bytes_out, planes.size() * planes[0].size());
+
+    if (progress_callback) {
+        report_progress();
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+void audio_demuxer_obj::mark_packet_read(const AVPacket *current_packet) {
+    auto *stream = in_fmt_ctx->streams[audio_stream_index];
+    auto position = next_read_position;
+    if (current_packet->pts != AV_NOPTS_VALUE) {
+        auto stream_start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        position = av_rescale_q(current_packet->pts - stream_start, stream->time_base, av_make_q(1, out_sample_rate_hz));
+    }
+    next_read_position = position + av_rescale_q(current_packet->duration,
+                                                  stream->time_base,
+                                                  av_make_q(1, out_sample_rate_hz));
+    packet_read_marks.push_back({position, std::chrono::steady_clock::now()});
+}
+
+void audio_demuxer_obj::record_latency(int64_t first_sample) {
+    // the oldest sample of the chunk came with the last packet starting at or
+    // before it, samples held back by the decoder or the stages count from there
+    while (packet_read_marks.size() > 1 && packet_read_marks[1].position <= first_sample) {
+        packet_read_marks.pop_front();
+    }
+    if (!packet_read_marks.empty()) {
+        latency_histogram.record(elapsed_ns(packet_read_marks.front().read_time));
+    }
+}
+
+void audio_demuxer_obj::report_progress() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_progress < progress_interval) {
+        return;
+    }
+    last_progress = now;
+    progress_callback(demuxer_stats);
+}
+
+std::error_code audio_demuxer_obj::flush_conversion(int read_result) {
+    if (!passthrough) {
+        // a fan-out target is handed decoded frames, it has no decoder to drain
+        std::error_code flash_result = audio_demuxer_errc::SUCCESS;
+        if (audio_decoder_ctx != nullptr) {
+            flash_result = decode_packet(nullptr, *conversion_sink);
+        }
+        if (flash_result == audio_demuxer_errc::SUCCESS) {
+            flash_result = flush_resampler(*conversion_sink);
+        }
+        if (flash_result != audio_demuxer_errc::SUCCESS) {
+            return flash_result;
+        }
+    }
+    AUDIO_STATS_ADD(demuxer_stats.allocations, resampler->get_dst_alloc_count() - conversion_allocations);
+
+    // only a pass that read the whole stream leaves a complete index, a read
+    // error ends the input early too; a failed save costs nothing but the next
+    // open building it again
+    if (seek_index_building && read_result == AVERROR_EOF && !stop_requested) {
+        seek_index.save(seek_index_file, seek_index_identity);
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::finish_conversion(std::error_code result) {
+    // stages hold back samples (pending frames, partial windows) until the end
+    if (conversion_stage != nullptr) {
+        if (result == audio_demuxer_errc::SUCCESS) {
+            result = conversion_stage->finish();
+        }
+        kept_segments = conversion_stage->get_kept_segments();
+    }
+    if (conversion_chunker != nullptr && result == audio_demuxer_errc::SUCCESS) {
+        result = conversion_chunker->finish();
+    }
+    if (memory_arena != nullptr) {
+        demuxer_stats.memory_peak = memory_arena->get_peak();
+    }
+    release_conversion_state();
+
+    return result;
+}
+
+void audio_demuxer_obj::release_conversion_state() {
+    // the stages allocate from the arena, they go first
+    conversion_stage.reset();
+    conversion_chunker.reset();
+    conversion_sink = nullptr;
+    if (memory_arena == nullptr) {
+        return;
+    }
+
+    // frames held by the decoder return to the arena's pool, which is freed
+    // (and the budget reservation returned) once the last of them is released
+    if (audio_decoder_ctx != nullptr) {
+        memory_arena->detach_decoder(audio_decoder_ctx);
+        avcodec_flush_buffers(audio_decoder_ctx);
+    }
+    if (in_frame != nullptr) {
+        av_frame_unref(in_frame);
+    }
+    memory_arena->close();
+    memory_arena.reset();
+    charged_dst_bytes = 0;
+}
+
+std::error_code audio_demuxer_obj::admit_child_conversions(std::size_t count) {
+    // all or nothing: a conversion holding part of its children's limits while
+    // it waits for the rest would block every other one doing the same
+    auto limit = memory_opts.conversion_limit_bytes;
+    if (limit == 0 || memory_opts.budget == nullptr) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+    if (count > SIZE_MAX / limit || !memory_opts.budget->acquire(count * limit, memory_opts.admission_timeout)) {
+        return audio_demuxer_errc::MEMORY_ADMISSION_ERR;
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+void audio_demuxer_obj::release_child_admissions(std::size_t count) {
+    if (memory_opts.conversion_limit_bytes > 0 && memory_opts.budget != nullptr) {
+        memory_opts.budget->release(count * memory_opts.conversion_limit_bytes);
+    }
+}
+
+std::error_code audio_demuxer_obj::check_memory_budget() {
+    if (memory_arena == nullptr) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    // the resampler buffers are grow-only, only their growth is charged
+    auto dst_bytes = resampler->get_dst_buffer_bytes();
+    if (dst_bytes > charged_dst_bytes) {
+        memory_arena->force_charge(dst_bytes - charged_dst_bytes);
+    } else {
+        memory_arena->discharge(charged_dst_bytes - dst_bytes);
+    }
+    charged_dst_bytes = dst_bytes;
+
+    if (memory_arena->is_exceeded()) {
+        return audio_demuxer_errc::MEMORY_LIMIT_ERR;
+    }
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::passthrough_packet(const AVPacket *current_packet, audio_sink_obj &sink) {
+    // pcm demuxers return whole sample frames (multiples of block_align)
+    auto frame_size = static_cast<int64_t>(av_get_bytes_per_sample(out_format)) * audio_decoder_ctx->channels;
+    auto nb_samples = current_packet->size / frame_size;
+    if (nb_samples == 0) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+    AUDIO_STATS_ADD(demuxer_stats.frames, 1);
+    AUDIO_STATS_ADD(demuxer_stats.samples_in, nb_samples);
+
+    std::span<const uint8_t> plane(current_packet->data, static_cast<size_t>(nb_samples * frame_size));
+    return output_samples(current_packet->pts, std::span(&plane, 1), nb_samples, sink);
+}
+
+std::error_code audio_demuxer_obj::flush_resampler(audio_sink_obj &sink) {
+    // the resample filter holds back its look-ahead until the input ends
+    if (range_done) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+    AUDIO_STATS_START(resample_start);
+    auto flush_result = resampler->flush();
+    AUDIO_STATS_STOP(demuxer_stats.resample_ns, resample_start);
+    if (flush_result != audio_resampler_err::SUCCESS) {
+        return audio_demuxer_errc::CONVERT_SAMPLES_ERR;
+    }
+    if (resampler->get_output_nb_samples() == 0) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    return output_samples(AV_NOPTS_VALUE,
+                          resampler->get_output_planes(),
+                          resampler->get_output_nb_samples(),
+                          sink);
+}
+
+template<typename Handler>
+std::error_code audio_demuxer_obj::decode_frames(const AVPacket *current_packet, Handler &&handler) {
+    AUDIO_STATS_START(send_start);
+    auto result = avcodec_send_packet(audio_decoder_ctx, current_packet);
+    AUDIO_STATS_STOP(demuxer_stats.decode_ns, send_start);
+    if (result < 0) {
+        return audio_demuxer_errc::SEND_PACKET_TO_DECODER_ERR;
+    }
+
+    while (true) {
+        AUDIO_STATS_START(receive_start);
+        result = avcodec_receive_frame(audio_decoder_ctx, in_frame);
+        AUDIO_STATS_STOP(demuxer_stats.decode_ns, receive_start);
+        if (result < 0) {
+            if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) {
+                break ;
+            }
+            return audio_demuxer_errc::RECEIVE_PACKET_FROM_DECODER_ERR;
+        }
+        AUDIO_STATS_ADD(demuxer_stats.frames, 1);
+        AUDIO_STATS_ADD(demuxer_stats.samples_in, in_frame->nb_samples);
+
+        auto frame_result = handler(in_frame);
+        av_frame_unref(in_frame);
+        if (frame_result) {
+            return frame_result;
+        }
+        if (range_done) {
+            break ;
+        }
+
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::decode_packet(const AVPacket *current_packet, audio_sink_obj &sink) {
+    return decode_frames(current_packet, [&](AVFrame *frame) { return convert_frame(frame, sink); });
+}
+
+std::error_code audio_demuxer_obj::convert_frame(AVFrame *frame, audio_sink_obj &sink) {
+    auto frame_pts = frame->best_effort_timestamp;
+    AUDIO_STATS_START(resample_start);
+    auto convert_result = resampler->convert(frame);
+    AUDIO_STATS_STOP(demuxer_stats.resample_ns, resample_start);
+    if (convert_result != audio_resampler_err::SUCCESS) {
+        return audio_demuxer_errc::CONVERT_SAMPLES_ERR;
+    }
+
+    return output_samples(frame_pts,
+                          resampler->get_output_planes(),
+                          resampler->get_output_nb_samples(),
+                          sink);
+}
+
+// pipelined mode
+
+namespace {
+
+// yields for a short while, which covers the usual hand-off between stages,
+// then blocks on the queue so a stalled stage costs no cpu
+constexpr int pipeline_spin_count = 64;
+
+// waits until an item is available, false when the pipeline is aborted
+// whoever sets abort wakes the queues
+template<typename T>
+bool pop_wait(spsc_queue<T> &queue, T &item, const std::atomic<bool> &abort, std::uint64_t &stall_ns) {
+    if (queue.try_pop(item)) {
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto popped = false;
+    for (int i = 0; i < pipeline_spin_count && !popped && !abort.load(); ++i) {
+        std::this_thread::yield();
+        popped = queue.try_pop(item);
+    }
+    if (!popped) {
+        queue.wait_until([&]() {
+            popped = queue.try_pop(item);
+            return popped || abort.load();
+        });
+    }
+    stall_ns += elapsed_ns(start);
+    return popped;
+}
+
+// queues are sized to hold the whole pool plus the end marker, so pushes never wait
+template<typename T>
+void push(spsc_queue<T> &queue, const T &item) {
+    if (!queue.try_push(item)) {
+        queue.wait_until([&]() { return queue.try_push(item); });
+    }
+}
+
+}
+
+std::error_code audio_demuxer_obj::run_pipelined(audio_sink_obj &sink) {
+    pipeline_stats = {};
+
+    auto packet_pool_size = std::max<size_t>(pipeline_opts.packet_queue_size, 1);
+    auto frame_pool_size = std::max<size_t>(pipeline_opts.frame_queue_size, 1);
+
+    // pooled objects are allocated once per conversion, nullptr marks the end of stream
+    std::vector<AVPacket *> packet_pool;
+    std::vector<AVFrame *> frame_pool;
+    auto free_pools = [&]() {
+        for (auto *item : packet_pool) {
+            av_packet_free(&item);
+        }
+        for (auto *item : frame_pool) {
+            av_frame_free(&item);
+        }
+    };
+
+    spsc_queue<AVPacket *> free_packets(packet_pool_size + 1);
+    spsc_queue<AVPacket *> full_packets(packet_pool_size + 1);
+    spsc_queue<AVFrame *> free_frames(frame_pool_size + 1);
+    spsc_queue<AVFrame *> full_frames(frame_pool_size + 1);
+
+    for (size_t i = 0; i < packet_pool_size; ++i) {
+        auto *item = av_packet_alloc();
+        if (item == nullptr) {
+            free_pools();
+            return audio_demuxer_errc::ALLOC_PACKET_ERR;
+        }
+        packet_pool.push_back(item);
+        free_packets.try_push(item);
+    }
+    for (size_t i = 0; i < frame_pool_size; ++i) {
+        auto *item = av_frame_alloc();
+        if (item == nullptr) {
+            free_pools();
+            return audio_demuxer_errc::ALLOC_IN_FRAME_ERR;
+        }
+        frame_pool.push_back(item);
+        free_frames.try_push(item);
+    }
+
+    std::atomic<bool> abort(false);
+    auto stop_pipeline = [&]() {
+        abort = true;
+        free_packets.wake();
+        full_packets.wake();
+        free_frames.wake();
+        full_frames.wake();
+    };
+    std::error_code decode_result = audio_demuxer_errc::SUCCESS;
+    std::error_code output_result = audio_demuxer_errc::SUCCESS;
+
+    // worker stages count into their own stats, merged after join
+    audio_demuxer_stats demux_stats;
+    audio_demuxer_stats decode_stats;
+
+    // demux stage
+    std::thread demux_thread([&]() {
+        auto &stats = pipeline_stats.demux;
+        while (true) {
+            AVPacket *item = nullptr;
+            if (!pop_wait(free_packets, item, abort, stats.output_stall_ns)) {
+                return;
+            }
+
+            AUDIO_STATS_START(read_start);
+            auto read_result = read_packet(item);
+            while (read_result >= 0 && item->stream_index != audio_stream_index) {
+                av_packet_unref(item);
+                read_result = read_packet(item);
+            }
+            AUDIO_STATS_STOP(demux_stats.read_ns, read_start);
+            if (read_result < 0) {
+                break ;
+            }
+
+            ++stats.items;
+            AUDIO_STATS_ADD(demux_stats.packets, 1);
+            AUDIO_STATS_ADD(demux_stats.bytes_in, item->size);
+            push(full_packets, item);
+        }
+        push(full_packets, static_cast<AVPacket *>(nullptr));
+    });
+
+    // decode stage
+    std::thread decode_thread([&]() {
+        auto &stats = pipeline_stats.decode;
+        AVFrame *spare_frame = nullptr;
+        while (true) {
+            AVPacket *item = nullptr;
+            if (!pop_wait(full_packets, item, abort, stats.input_stall_ns)) {
+                return;
+            }
+
+            AUDIO_STATS_START(send_start);
+            auto result = avcodec_send_packet(audio_decoder_ctx, item);
+            AUDIO_STATS_STOP(decode_stats.decode_ns, send_start);
+            if (item != nullptr) {
+                av_packet_unref(item);
+                push(free_packets, item);
+            }
+            if (result < 0) {
+                decode_result = audio_demuxer_errc::SEND_PACKET_TO_DECODER_ERR;
+                stop_pipeline();
+                return;
+            }
+
+            while (true) {
+                if (spare_frame == nullptr && !pop_wait(free_frames, spare_frame, abort, stats.output_stall_ns)) {
+                    return;
+                }
+                AUDIO_STATS_START(receive_start);
+                result = avcodec_receive_frame(audio_decoder_ctx, spare_frame);
+                AUDIO_STATS_STOP(decode_stats.decode_ns, receive_start);
+                if (result < 0) {
+                    if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) {
+                        break ;
+                    }
+                    decode_result = audio_demuxer_errc::RECEIVE_PACKET_FROM_DECODER_ERR;
+                    stop_pipeline();
+                    return;
+                }
+                ++stats.items;
+                AUDIO_STATS_ADD(decode_stats.frames, 1);
+                AUDIO_STATS_ADD(decode_stats.samples_in, spare_frame->nb_samples);
+                push(full_frames, spare_frame);
+                spare_frame = nullptr;
+            }
+
+            if (item == nullptr) {
+                push(full_frames, static_cast<AVFrame *>(nullptr));
+                return;
+            }
+        }
+    });
+
+    // resample + output stage runs on the calling thread
+    auto &stats = pipeline_stats.output;
+    while (true) {
+        AVFrame *item = nullptr;
+        if (!pop_wait(full_frames, item, abort, stats.input_stall_ns)) {
+            break ;
+        }
+        if (item == nullptr) {
+            output_result = flush_resampler(sink);
+            break ;
+        }
+
+        auto frame_pts = item->best_effort_timestamp;
+        AUDIO_STATS_START(resample_start);
+        auto convert_result = resampler->convert(item);
+        AUDIO_STATS_STOP(demuxer_stats.resample_ns, resample_start);
+        av_frame_unref(item);
+        push(free_frames, item);
+        if (convert_result != audio_resampler_err::SUCCESS) {
+            output_result = audio_demuxer_errc::CONVERT_SAMPLES_ERR;
+            stop_pipeline();
+            break ;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto sink_result = output_samples(frame_pts,
+                                          resampler->get_output_planes(),
+                                          resampler->get_output_nb_samples(),
+                                          sink);
+        stats.output_stall_ns += elapsed_ns(start);
+        ++stats.items;
+        if (!sink_result) {
+            // the decode thread keeps filling the arena, the limit is enforced per frame
+            sink_result = check_memory_budget();
+        }
+        if (sink_result) {
+            output_result = sink_result;
+            stop_pipeline();
+            break ;
+        }
+        if (range_done) {
+            // the requested range is complete, stop the upstream stages
+            stop_pipeline();
+            break ;
+        }
+    }
+
+    demux_thread.join();
+    decode_thread.join();
+    free_pools();
+
+    audio_stats_merge(demuxer_stats, demux_stats);
+    audio_stats_merge(demuxer_stats, decode_stats);
+
+    if (decode_result != audio_demuxer_errc::SUCCESS) {
+        return decode_result;
+    }
+
+    return output_result;
+}
+
+// multi-stream mode
+
+namespace {
+
+// runs a handler on its own thread behind a queue of pooled packets or frames,
+// nullptr marks the end of the stream and is handed to the handler as well
+template<typename T>
+class audio_queue_worker_obj final {
+public:
+    using handler_type = std::function<std::error_code(T *)>;
+
+    audio_queue_worker_obj() = default;
+    // Disallow copying
+    audio_queue_worker_obj(audio_queue_worker_obj &other) = delete;
+    audio_queue_worker_obj &operator=(audio_queue_worker_obj &other) = delete;
+
+    ~audio_queue_worker_obj() {
+        if (worker.joinable()) {
+            stop();
+            worker.join();
+        }
+        for (auto *item : pool) {
+            free_item(item);
+        }
+    }
+
+    std::error_code start(size_t queue_size, handler_type item_handler) {
+        handler = std::move(item_handler);
+        free_items = std::make_unique<spsc_queue<T *> >(queue_size + 1);
+        full_items = std::make_unique<spsc_queue<T *> >(queue_size + 1);
+        for (size_t i = 0; i < queue_size; ++i) {
+            auto *item = alloc_item();
+            if (item == nullptr) {
+                return std::is_same_v<T, AVPacket> ? audio_demuxer_errc::ALLOC_PACKET_ERR :
+                                                     audio_demuxer_errc::ALLOC_IN_FRAME_ERR;
+            }
+            pool.push_back(item);
+            free_items->try_push(item);
+        }
+
+        worker = std::thread([this]() {
+            std::uint64_t stall_ns = 0;
+            while (true) {
+                T *item = nullptr;
+                if (!pop_wait(*full_items, item, abort, stall_ns)) {
+                    return;
+                }
+                auto result = handler(item);
+                if (item != nullptr) {
+                    unref_item(item);
+                    push(*free_items, item);
+                }
+                if (result != audio_demuxer_errc::SUCCESS) {
+                    worker_result = result;
+                    stop();
+                    return;
+                }
+                if (item == nullptr) {
+                    return;
+                }
+            }
+        });
+
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    // packets are moved into the pool, frames are referenced, waits while the worker is behind
+    std::error_code submit(T *src) {
+        T *item = nullptr;
+        std::uint64_t stall_ns = 0;
+        if (!pop_wait(*free_items, item, abort, stall_ns)) {
+            return worker_result;
+        }
+        if constexpr (std::is_same_v<T, AVPacket>) {
+            av_packet_move_ref(item, src);
+        } else if (av_frame_ref(item, src) < 0) {
+            push(*free_items, item);
+            return audio_demuxer_errc::ALLOC_IN_FRAME_ERR;
+        }
+        push(*full_items, item);
+
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    std::error_code finish() {
+        if (!worker.joinable()) {
+            return worker_result;
+        }
+        if (!abort) {
+            push(*full_items, static_cast<T *>(nullptr));
+        }
+        worker.join();
+
+        return worker_result;
+    }
+
+private:
+    handler_type                        handler;
+    std::vector<T *>                    pool;
+    std::unique_ptr<spsc_queue<T *> >   free_items;
+    std::unique_ptr<spsc_queue<T *> >   full_items;
+    std::thread                         worker;
+    std::atomic<bool>                   abort {false};
+    std::error_code                     worker_result = audio_demuxer_errc::SUCCESS;
+
+    // the worker and submit may be blocked on either queue
+    void stop() {
+        abort = true;
+        free_items->wake();
+        full_items->wake();
+    }
+
+    static T *alloc_item() {
+        if constexpr (std::is_same_v<T, AVPacket>) {
+            return av_packet_alloc();
+        } else {
+            return av_frame_alloc();
+        }
+    }
+
+    static void unref_item(T *item) {
+        if constexpr (std::is_same_v<T, AVPacket>) {
+            av_packet_unref(item);
+        } else {
+            av_frame_unref(item);
+        }
+    }
+
+    static void free_item(T *item) {
+        if constexpr (std::is_same_v<T, AVPacket>) {
+            av_packet_free(&item);
+        } else {
+            av_frame_free(&item);
+        }
+    }
+};
+
+}
+
+std::unique_ptr<audio_demuxer_obj> audio_demuxer_obj::create_stream_conversion(int sample_rate_hz,
+                                                                               AVSampleFormat format,
+                                                                               int64_t ch_layout) {
+    auto input = src_filename;
+    auto stream = std::make_unique<audio_demuxer_obj>(input, sample_rate_hz, format, ch_layout, decoder_opts);
+    stream->context_pool = context_pool;
+    stream->dsp_opts = dsp_opts;
+    stream->chunk_opts = chunk_opts;
+    stream->memory_opts = memory_opts;
+    // the caller reserved the limit with admit_child_conversions
+    stream->memory_admitted = true;
+
+    // the range is kept in samples at the output rate
+    auto rescale = [&](int64_t sample, int64_t open_end) {
+        return sample == open_end ? open_end : av_rescale(sample, sample_rate_hz, out_sample_rate_hz);
+    };
+    stream->range_start_sample = rescale(range_start_sample, INT64_MIN);
+    stream->range_end_sample = rescale(range_end_sample, INT64_MAX);
+
+    return stream;
+}
+
+std::error_code audio_demuxer_obj::open_stream_conversion(AVFormatContext *shared_fmt_ctx,
+                                                          int stream_index,
+                                                          audio_sink_obj &sink,
+                                                          const AVCodecContext *frame_source) {
+    kept_segments.clear();
+    clean_up_resources();
+
+    auto result = open_stages(sink);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+
+    // packets (or decoded frames) are handed over by the demuxer that owns the input
+    in_fmt_ctx = shared_fmt_ctx;
+    shared_input = true;
+    seek_index_building = false;
+    if (frame_source != nullptr) {
+        audio_stream_index = stream_index;
+        passthrough = false;
+        result = init_resampler(frame_source);
+        if (result == audio_demuxer_errc::SUCCESS) {
+            conversion_allocations = resampler->get_dst_alloc_count();
+        }
+        return result;
+    }
+    result = open_codec_context(stream_index);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+
+    return open_decoding();
+}
+
+std::error_code audio_demuxer_obj::get_audio_streams(std::vector<int> &stream_indexes) {
+    stop_requested = false;
+    clean_up_resources();
+    auto result = get_input_file_info();
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+
+    stream_indexes.clear();
+    for (unsigned i = 0; i < in_fmt_ctx->nb_streams; ++i) {
+        if (in_fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            stream_indexes.push_back(static_cast<int>(i));
+        }
+    }
+    clean_up_resources();
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_demuxer_obj::convert_streams(const std::vector<audio_stream_output> &outputs, bool parallel) {
+    stop_requested = false;
+    clean_up_resources();
+    converted_samples = 0;
+    out_position_known = false;
+    out_position_required = false;
+    demuxer_stats = {};
+    last_progress = std::chrono::steady_clock::now();
+
+    auto result = get_input_file_info();
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+    if (outputs.empty()) {
+        return audio_demuxer_errc::FIND_INPUT_STREAM_ERR;
+    }
+
+    packet = av_packet_alloc();
+    if (packet == nullptr) {
+        return audio_demuxer_errc::ALLOC_PACKET_ERR;
+    }
+
+    std::vector<bool> selected(in_fmt_ctx->nb_streams, false);
+    for (auto & item : outputs) {
+        if (item.stream_index < 0 || item.stream_index >= static_cast<int>(in_fmt_ctx->nb_streams) ||
+            item.sink == nullptr ||
+            in_fmt_ctx->streams[item.stream_index]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) {
+            return audio_demuxer_errc::FIND_INPUT_STREAM_ERR;
+        }
+        if (selected[static_cast<size_t>(item.stream_index)]) {
+            return audio_demuxer_errc::DUPLICATE_STREAM_ERR;
+        }
+        selected[static_cast<size_t>(item.stream_index)] = true;
+    }
+
+    result = admit_child_conversions(outputs.size());
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+
+    // conversion per selected stream on the shared input, indexed by the container stream index
+    std::vector<std::unique_ptr<audio_demuxer_obj> > streams(in_fmt_ctx->nb_streams);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        auto &item = outputs[i];
+        auto stream = create_stream_conversion(out_sample_rate_hz, out_format, out_ch_layout);
+        result = stream->open_stream_conversion(in_fmt_ctx, item.stream_index, *item.sink);
+        if (result != audio_demuxer_errc::SUCCESS) {
+            // opened conversions return their share through their arenas
+            release_child_admissions(outputs.size() - i - 1);
+            return result;
+        }
+        streams[static_cast<size_t>(item.stream_index)] = std::move(stream);
+    }
+
+    // other streams are not demuxed at all
+    for (unsigned i = 0; i < in_fmt_ctx->nb_streams; ++i) {
+        if (streams[i] == nullptr) {
+            in_fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    // one seek for all streams, the first selected stream drives it; after a
+    // seek every stream takes its position from the first frame's pts
+    audio_stream_index = outputs.front().stream_index;
+    load_seek_index();
+    seek_to_range_start();
+    for (auto & item : streams) {
+        if (item != nullptr) {
+            item->out_position_required = out_position_required;
+        }
+    }
+
+    // packets behind a stream's range end are dropped
+    auto convert_stream = [](audio_demuxer_obj &stream, const AVPacket *current_packet) -> std::error_code {
+        if (current_packet == nullptr && stream.range_done) {
+            // as in the single-stream path, a finished range leaves nothing to drain
+            AUDIO_STATS_ADD(stream.demuxer_stats.allocations,
+                            stream.resampler->get_dst_alloc_count() - stream.conversion_allocations);
+            return audio_demuxer_errc::SUCCESS;
+        }
+        if (current_packet == nullptr) {
+            // the parent reads the input, stream conversions build no seek index
+            return stream.flush_conversion(AVERROR_EOF);
+        }
+        if (stream.range_done) {
+            return audio_demuxer_errc::SUCCESS;
+        }
+        return stream.convert_packet(current_packet);
+    };
+
+    std::vector<std::unique_ptr<audio_queue_worker_obj<AVPacket> > > workers(streams.size());
+    if (parallel) {
+        for (size_t i = 0; i < streams.size() && result == audio_demuxer_errc::SUCCESS; ++i) {
+            if (streams[i] == nullptr) {
+                continue ;
+            }
+            workers[i] = std::make_unique<audio_queue_worker_obj<AVPacket> >();
+            result = workers[i]->start(std::max<size_t>(pipeline_opts.packet_queue_size, 1),
+                                       [convert_stream, stream = streams[i].get()](AVPacket *item) {
+                                           return convert_stream(*stream, item);
+                                       });
+        }
+    }
+
+    auto all_done = [&]() {
+        return std::all_of(streams.begin(), streams.end(), [](const auto &item) {
+            return item == nullptr || item->range_done;
+        });
+    };
+
+    int read_result = 0;
+    while (result == audio_demuxer_errc::SUCCESS && !stop_requested && !all_done()) {
+        AUDIO_STATS_START(read_start);
+        read_result = read_packet(packet);
+        AUDIO_STATS_STOP(demuxer_stats.read_ns, read_start);
+        if (read_result < 0) {
+            break ;
+        }
+
+        // streams may appear after the header for some containers
+        auto index = static_cast<size_t>(packet->stream_index);
+        auto *stream = index < streams.size() ? streams[index].get() : nullptr;
+        if (stream != nullptr) {
+            AUDIO_STATS_ADD(demuxer_stats.packets, 1);
+            AUDIO_STATS_ADD(demuxer_stats.bytes_in, packet->size);
+            if (seek_index_building && packet->stream_index == audio_stream_index) {
+                add_seek_index_entry(packet);
+            }
+            result = parallel ? workers[index]->submit(packet) : convert_stream(*stream, packet);
+        }
+        av_packet_unref(packet);
+        if (progress_callback) {
+            report_progress();
+        }
+    }
+    // the index is complete only when reading stopped at the end of the file
+    if (result == audio_demuxer_errc::SUCCESS && seek_index_building && read_result == AVERROR_EOF && !stop_requested) {
+        seek_index.save(seek_index_file, seek_index_identity);
+    }
+
+    for (size_t i = 0; i < streams.size(); ++i) {
+        if (streams[i] == nullptr) {
+            continue ;
+        }
+        auto stream_result = result;
+        if (workers[i] != nullptr) {
+            auto finish_result = workers[i]->finish();
+            if (stream_result == audio_demuxer_errc::SUCCESS) {
+                stream_result = finish_result;
+            }
+        } else if (stream_result == audio_demuxer_errc::SUCCESS) {
+            stream_result = convert_stream(*streams[i], nullptr);
+        }
+        stream_result = streams[i]->finish_conversion(stream_result);
+        if (result == audio_demuxer_errc::SUCCESS) {
+            result = stream_result;
+        }
+        converted_samples += streams[i]->get_converted_samples();
+        audio_stats_merge(demuxer_stats, streams[i]->get_stats());
+    }
+
+    return result;
+}
+
+std::error_code audio_demuxer_obj::convert_all_streams(const std::filesystem::path &output_prefix,
+                                                       bool parallel,
+                                                       const audio_pcm_writer_options &writer_options) {
+    std::vector<int> stream_indexes;
+    auto result = get_audio_streams(stream_indexes);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+    // convert_streams starts a new call, a stop requested while probing ends it here
+    if (stop_requested) {
+        converted_samples = 0;
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    // <prefix>.<stream index>
+    std::vector<std::unique_ptr<audio_pcm_writer_obj> > writers;
+    std::vector<audio_stream_output> outputs;
+    for (auto index : stream_indexes) {
+        auto output_file = output_prefix;
+        output_file += "." + std::to_string(index);
+        auto writer = audio_pcm_writer_obj::create_audio_pcm_writer_obj(output_file, writer_options);
+        if (writer == nullptr) {
+            return audio_demuxer_errc::OPEN_OUTPUT_FSTREAM_ERR;
+        }
+        outputs.push_back({index, writer.get()});
+        writers.push_back(std::move(writer));
+    }
+
+    result = convert_streams(outputs, parallel);
+    for (auto & item : writers) {
+        auto finish_result = item->finish();
+        if (result == audio_demuxer_errc::SUCCESS) {
+            result = finish_result;
+        }
+    }
+
+    return result;
+}
+
+// fan-out mode
+
+std::error_code audio_demuxer_obj::convert(const std::vector<audio_target_spec> &targets, bool parallel) {
+    stop_requested = false;
+    clean_up_resources();
+    converted_samples = 0;
+    out_position_known = false;
+    out_position_required = false;
+    range_done = false;
+    demuxer_stats = {};
+    last_progress = std::chrono::steady_clock::now();
+
+    auto result = get_input_file_info();
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+    if (targets.empty()) {
+        return audio_demuxer_errc::WRONG_INIT_DATA_FOR_RESAMPLER;
+    }
+
+    in_frame = av_frame_alloc();
+    if (in_frame == nullptr) {
+        return audio_demuxer_errc::ALLOC_IN_FRAME_ERR;
+    }
+
+    packet = av_packet_alloc();
+    if (packet == nullptr) {
+        return audio_demuxer_errc::ALLOC_PACKET_ERR;
+    }
+
+    for (auto & item : targets) {
+        if (item.sink == nullptr) {
+            return audio_demuxer_errc::WRONG_INIT_DATA_FOR_RESAMPLER;
+        }
+    }
+
+    result = admit_child_conversions(targets.size());
+    if (result != audio_demuxer_errc::SUCCESS) {
+        return result;
+    }
+
+    // conversion per target on the shared input, fed with this demuxer's decoded frames
+    std::vector<std::unique_ptr<audio_demuxer_obj> > conversions;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        auto &item = targets[i];
+        auto target = create_stream_conversion(item.sample_rate_hz, item.format, item.ch_layout);
+        result = target->open_stream_conversion(in_fmt_ctx, audio_stream_index, *item.sink, audio_decoder_ctx);
+        if (result != audio_demuxer_errc::SUCCESS) {
+            // opened conversions return their share through their arenas
+            release_child_admissions(targets.size() - i - 1);
+            return result;
+        }
+        conversions.push_back(std::move(target));
+    }
+
+    // after a seek every target takes its position from the first frame's pts
+    load_seek_index();
+    seek_to_range_start();
+    for (auto & item : conversions) {
+        item->out_position_required = out_position_required;
+    }
+
+    // frames behind a target's range end are dropped
+    auto convert_target = [](audio_demuxer_obj &target, AVFrame *frame) -> std::error_code {
+        if (frame == nullptr) {
+            // the parent reads the input, target conversions build no seek index
+            return target.flush_conversion(AVERROR_EOF);
+        }
+        if (target.range_done) {
+            return audio_demuxer_errc::SUCCESS;
+        }
+        auto target_result = target.convert_frame(frame, *target.conversion_sink);
+        auto memory_result = target.check_memory_budget();
+        if (memory_result) {
+            target_result = memory_result;
+        }
+        return target_result;
+    };
+
+    std::vector<std::unique_ptr<audio_queue_worker_obj<AVFrame> > > workers(conversions.size());
+    if (parallel) {
+        for (size_t i = 0; i < conversions.size() && result == audio_demuxer_errc::SUCCESS; ++i) {
+            workers[i] = std::make_unique<audio_queue_worker_obj<AVFrame> >();
+            result = workers[i]->start(std::max<size_t>(pipeline_opts.frame_queue_size, 1),
+                                       [convert_target, target = conversions[i].get()](AVFrame *item) {
+                                           return convert_target(*target, item);
+                                       });
+        }
+    }
+
+    // one decode, every target converts the same frame; decoding ends once
+    // every target reached its range end
+    auto to_targets = [&](AVFrame *frame) -> std::error_code {
+        for (size_t i = 0; i < conversions.size(); ++i) {
+            auto target_result = parallel ? workers[i]->submit(frame) : convert_target(*conversions[i], frame);
+            if (target_result != audio_demuxer_errc::SUCCESS) {
+                return target_result;
+            }
+        }
+        range_done = std::all_of(conversions.begin(), conversions.end(), [](const auto &item) {
+            return item->range_done.load();
+        });
+        return audio_demuxer_errc::SUCCESS;
+    };
+
+    int read_result = 0;
+    while (result == audio_demuxer_errc::SUCCESS && !stop_requested && !range_done) {
+        AUDIO_STATS_START(read_start);
+        read_result = read_packet(packet);
+        AUDIO_STATS_STOP(demuxer_stats.read_ns, read_start);
+        if (read_result < 0) {
+            break ;
+        }
+        if (packet->stream_index == audio_stream_index) {
+            AUDIO_STATS_ADD(demuxer_stats.packets, 1);
+            AUDIO_STATS_ADD(demuxer_stats.bytes_in, packet->size);
+            if (seek_index_building) {
+                add_seek_index_entry(packet);
+            }
+            result = decode_frames(packet, to_targets);
+        }
+        av_packet_unref(packet);
+        if (progress_callback) {
+            report_progress();
+        }
+    }
+    if (result == audio_demuxer_errc::SUCCESS && !range_done) {
+        result = decode_frames(nullptr, to_targets);
+        if (result == audio_demuxer_errc::SUCCESS && seek_index_building && read_result == AVERROR_EOF && !stop_requested) {
+            seek_index.save(seek_index_file, seek_index_identity);
+        }
+    }
+
+    for (size_t i = 0; i < conversions.size(); ++i) {
+        auto target_result = result;
+        if (workers[i] != nullptr) {
+            auto finish_result = workers[i]->finish();
+            if (target_result == audio_demuxer_errc::SUCCESS) {
+                target_result = finish_result;
+            }
+        } else if (target_result == audio_demuxer_errc::SUCCESS) {
+            target_result = convert_target(*conversions[i], nullptr);
+        }
+        target_result = conversions[i]->finish_conversion(target_result);
+        if (result == audio_demuxer_errc::SUCCESS) {
+            result = target_result;
+        }
+        audio_stats_merge(demuxer_stats, conversions[i]->get_stats());
     }
+    converted_samples = conversions.front()->get_converted_samples();
 
+    return result;
 }
@@ -1,7 +1,13 @@
+#pragma once
+
 #include <filesystem>
 #include <vector>
 #include <memory>
 #include <system_error>
+#include <string>
+#include <memory_resource>
+#include <atomic>
+#include <deque>
 
 extern "C" {
 //decoder
@@ -14,6 +20,18 @@ extern "C" {
 #define __STDC_CONSTANT_MACROS
 
 #include "audio_resampler.h"
+#include "audio_sink.h"
+#include "audio_ring_buffer.h"
+#include "audio_pcm_writer.h"
+#include "audio_pipeline.h"
+#include "audio_context_pool.h"
+#include "audio_input_source.h"
+#include "audio_demuxer_stats.h"
+#include "audio_seek_index.h"
+#include "audio_streaming.h"
+#include "audio_dsp_stage.h"
+#include "audio_chunker.h"
+#include "audio_memory_arena.h"
 
 // error code
 
@@ -34,6 +52,17 @@ enum class audio_demuxer_errc {
     CONVERT_SAMPLES_ERR,
     SEND_PACKET_TO_DECODER_ERR,
     RECEIVE_PACKET_FROM_DECODER_ERR,
+    WRITE_OUTPUT_ERR,
+    ALLOC_IO_CONTEXT_ERR,
+    WRONG_MANIFEST_LINE_ERR,
+    INIT_DSP_STAGE_ERR,
+    INIT_CHUNKER_ERR,
+    NO_CONVERSION_ERR,
+    CONVERSION_CANCELLED_ERR,
+    MEMORY_ADMISSION_ERR,
+    MEMORY_LIMIT_ERR,
+    SAMPLE_POSITION_ERR,
+    DUPLICATE_STREAM_ERR,
 
 };
 
@@ -47,6 +76,41 @@ struct audio_demuxer_err_category : std::error_category {
     std::string message(int ev) const override;
 };
 
+// decoder settings
+
+struct audio_decoder_options {
+    int             thread_count = 1;       // 0 lets the decoder pick one per core
+    int             thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    bool            low_delay = false;      // AV_CODEC_FLAG_LOW_DELAY
+    AVDiscard       skip_frame = AVDISCARD_DEFAULT;
+    std::string     decoder_name;           // explicit decoder instead of the default for the codec id
+};
+
+// input probing settings, useful when the container is known in advance
+
+struct audio_probe_options {
+    std::int64_t    probesize = 0;              // bytes, 0 keeps the FFmpeg default
+    std::int64_t    analyzeduration = 0;        // microseconds, 0 keeps the FFmpeg default
+    std::string     format_name;                // forces the input format (e.g. "wav", "mov")
+    bool            skip_find_stream_info = false;  // trust the container header only
+};
+
+// destination of one container stream in multi-stream mode
+
+struct audio_stream_output {
+    int             stream_index;   // index of the audio stream in the container
+    audio_sink_obj  *sink;
+};
+
+// one output format of a fan-out conversion
+
+struct audio_target_spec {
+    int             sample_rate_hz;
+    AVSampleFormat  format;
+    std::int64_t    ch_layout;
+    audio_sink_obj  *sink;
+};
+
 // audio demuxer
 
 class audio_demuxer_obj final {
@@ -55,10 +119,124 @@ public:
     audio_demuxer_obj(std::filesystem::path &source_filename,
                       int result_sample_rate_hz,
                       AVSampleFormat result_format,
-                      int64_t result_ch_layout);
+                      int64_t result_ch_layout,
+                      const audio_decoder_options &decoder_options = {});
     ~audio_demuxer_obj();
 
-    std::error_code convert(const std::filesystem::path &output_file);
+    std::error_code convert(const std::filesystem::path &output_file,
+                            const audio_pcm_writer_options &writer_options = {});
+    std::error_code convert(audio_sink_obj &sink);
+    std::error_code convert(std::vector<uint8_t> &output);
+    std::error_code convert(std::pmr::vector<uint8_t> &output);
+    // closes the ring when decoding ends, so a consumer thread can drain it
+    std::error_code convert(audio_ring_buffer_obj &output);
+
+    // step by step conversion for callers that schedule the work themselves:
+    // start_conversion opens the input and chains the stages in front of the sink,
+    // every convert_next_packet call demuxes and converts one packet; done is set
+    // once the conversion ended (end of input, range end, stop request or error),
+    // the last call flushes the decoder, the resampler and the stages
+    // the pipelined mode does not apply
+    std::error_code start_conversion(audio_sink_obj &sink);
+    std::error_code convert_next_packet(bool &done);
+    // fan-out: decodes once and converts every frame to each target format,
+    // parallel runs each target's resampler on its own thread
+    // every target is converted like convert(sink) with the time range,
+    // processing, chunk and memory settings of this object (the memory limit
+    // applies per target and does not cover the shared decoded frames), its
+    // resampler comes from the context pool; the progress callback sees the
+    // demux and decode counters, the stats of the targets are added to
+    // get_stats when the conversion ends
+    std::error_code convert(const std::vector<audio_target_spec> &targets, bool parallel = false);
+
+    // the object can be reused for several files, decoder and resampler
+    // instances are returned to the context pool between conversions
+    void set_source(const std::filesystem::path &source_filename);
+    // reads the input through a custom AVIOContext instead of a file path
+    void set_source(std::shared_ptr<audio_input_source_obj> source, int io_buffer_size = 64 * 1024);
+    void set_probe_options(const audio_probe_options &options);
+    void set_context_pool(std::shared_ptr<audio_context_pool_obj> pool);
+
+    // limits the output to [start, start + duration) seconds of the stream,
+    // decoding starts from the closest earlier keyframe and the output is
+    // trimmed to the exact sample count at the target rate
+    // duration <= 0 runs to the end of the stream
+    void set_time_range(double start_sec, double duration_sec = 0.0);
+    // packet index sidecar for file sources: a full conversion from the stream
+    // start builds it, later conversions of the same file seek by byte offset
+    // from it instead of the container's seek logic as long as the demuxer
+    // resumes at the indexed packet; a matching sidecar also limits the stream
+    // probe to the codec parameters, an empty path disables it
+    void set_seek_index_file(const std::filesystem::path &sidecar_file);
+
+    // gain / VAD / silence dropping between the resampler and the sink, applied
+    // by convert(sink) and the overloads built on it
+    void set_dsp_options(const audio_dsp_options &options);
+    // input -> output sample map of the last convert call with silence dropping
+    const std::vector<audio_kept_segment> &get_kept_segments() const;
+    // fixed-size (optionally overlapping) windows to the sink, after the processing stage
+    void set_chunk_options(const audio_chunk_options &options);
+    // hard memory limit per conversion and admission against a shared budget,
+    // covers decoded frames, resampler output and the stage buffers of
+    // convert(sink) and the step by step conversion, not the demuxer's packets;
+    // multi-stream and fan-out conversions apply the limit per stream / target
+    // and admit all of them at once
+    void set_memory_options(const audio_memory_options &options);
+
+    void set_pipeline_options(const audio_pipeline_options &options);
+    // live inputs: the sink receives every frame as soon as it is decoded,
+    // pipelined mode is ignored while streaming
+    void set_streaming_options(const audio_streaming_options &options);
+    // end-to-end time from the packet holding the oldest sample of an output
+    // chunk leaving the demuxer to the chunk leaving the sink, one value per
+    // output chunk of the last streaming convert call
+    const audio_latency_histogram &get_latency_histogram() const;
+    // ends the running convert call from another thread, a blocked read is
+    // interrupted and what was decoded so far is flushed to the sink
+    // the request holds until the next convert call starts, so a request made
+    // while the input is still being opened ends the call as well
+    void request_stop();
+    const audio_pipeline_stats &get_pipeline_stats() const;
+    // samples per channel handed to the sink by the last convert call
+    std::uint64_t get_converted_samples() const;
+    // stage timings and counters of the last convert call
+    const audio_demuxer_stats &get_stats() const;
+    // true when the last convert call copied PCM packets straight to the sink
+    // because the input already matched the target format
+    bool is_passthrough() const;
+    // called from the converting thread at most once per interval while converting
+    void set_progress_callback(audio_progress_callback callback,
+                               std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+
+    // splits a long input into time segments decoded in parallel, each on its
+    // own contexts, every segment writes straight to its byte offset in the
+    // output file, so no segment is held in memory
+    // the block planar and separate files layouts, user time ranges and inputs
+    // that cannot be opened twice are converted serially, and so are inputs
+    // whose segments can not be placed exactly (no pts after the seek, a segment
+    // short of its range); direct_io does not apply to the segments
+    // nb_segments = 0 uses one segment per hardware thread
+    std::error_code convert_segmented(const std::filesystem::path &output_file,
+                                      unsigned nb_segments = 0,
+                                      const audio_pcm_writer_options &writer_options = {});
+    // stream duration probed by the last convert call, 0 when unknown
+    double get_input_duration() const;
+
+    // multi-stream mode: every selected audio stream gets its own decoder,
+    // resampler and sink, all fed from a single demux pass
+    // parallel runs each stream's decoder on its own thread
+    // every stream is converted like convert(sink) with the decoder, time range,
+    // processing, chunk and memory settings of this object (the memory limit
+    // applies per stream), the first selected stream drives the seek and the
+    // seek index; the progress callback sees the demux counters, the stats of
+    // the streams are added to get_stats when the conversion ends
+    // a stream index listed twice is an error
+    std::error_code get_audio_streams(std::vector<int> &stream_indexes);
+    std::error_code convert_streams(const std::vector<audio_stream_output> &outputs, bool parallel = true);
+    // every audio stream to <output_prefix>.<stream index>
+    std::error_code convert_all_streams(const std::filesystem::path &output_prefix,
+                                        bool parallel = true,
+                                        const audio_pcm_writer_options &writer_options = {});
 
 private:
 
@@ -67,21 +245,137 @@ private:
     AVSampleFormat          out_format;
     std::int64_t            out_ch_layout;
     int                     audio_stream_index;
+    audio_decoder_options   decoder_opts;
 
     AVFormatContext         *in_fmt_ctx;
+    bool                    shared_input;   // in_fmt_ctx belongs to the demuxer that reads the packets
+    AVIOContext             *in_io_ctx;
     AVCodecContext          *audio_decoder_ctx;
     AVFrame                 *in_frame;
     AVPacket                *packet;
 
     std::unique_ptr<audio_resampler_obj> resampler;
+    bool                    passthrough;
+
+    audio_probe_options     probe_opts;
+    std::shared_ptr<audio_input_source_obj> input_source;
+    int                     input_io_buffer_size;
+    std::shared_ptr<audio_context_pool_obj> context_pool;
+    audio_decoder_key       decoder_key;
+    audio_resampler_key     resampler_key;
+    std::uint64_t           converted_samples;
+    double                  input_duration_sec;
+
+    // output range in samples at the target rate, counted from the stream start
+    static constexpr double min_segment_sec = 30.0;
+    std::int64_t            range_start_sample;
+    std::int64_t            range_end_sample;
+    double                  range_preroll_sec;
+    std::int64_t            out_position;
+    bool                    out_position_known;
+    bool                    out_position_required;  // decoding started at a seek point
+    bool                    packet_pending;         // packet holds the packet read to verify a byte seek
+    std::atomic<bool>       range_done;     // read by the demuxing thread in multi-stream mode
+    int                     out_sample_stride;
+    std::vector<std::span<const uint8_t> > trimmed_planes;
+
+    // one index entry per interval of stream time is enough for the seek preroll
+    static constexpr int64_t seek_index_interval_ms = 100;
+    // probe limits for an indexed file, explicit probe options win
+    static constexpr int64_t seek_index_probesize = 32 * 1024;
+    static constexpr int64_t seek_index_analyzeduration = 100000;
+    std::filesystem::path   seek_index_file;
+    audio_seek_index_obj    seek_index;
+    audio_file_identity     seek_index_identity;
+    bool                    seek_index_identified;  // seek_index_identity holds the source file
+    bool                    seek_index_preloaded;   // seek_index holds the sidecar, stream not checked yet
+    bool                    seek_index_loaded;
+    bool                    seek_index_building;
+    std::int64_t            seek_index_next_pts;
+    std::int64_t            seek_index_last_pts;
+
+    audio_pipeline_options  pipeline_opts;
+    audio_pipeline_stats    pipeline_stats;
+
+    audio_dsp_options       dsp_opts;
+    std::vector<audio_kept_segment> kept_segments;
+    audio_chunk_options     chunk_opts;
+
+    // state of the running conversion, the sink is the head of the stage chain
+    audio_sink_obj          *conversion_sink;
+    std::unique_ptr<audio_dsp_stage_obj> conversion_stage;
+    std::unique_ptr<audio_chunker_obj> conversion_chunker;
+    std::uint64_t           conversion_allocations;    // resampler allocations before the first packet
+
+    audio_memory_options    memory_opts;
+    std::shared_ptr<audio_memory_arena_obj> memory_arena;
+    bool                    memory_admitted;            // the parent reserved this conversion's limit
+    std::size_t             charged_dst_bytes;          // resampler buffers charged to the arena
+
+    audio_streaming_options streaming_opts;
+    audio_latency_histogram latency_histogram;
+    std::atomic<bool>       stop_requested;
+    // read time of every packet by the output position of its first sample
+    struct packet_read_mark {
+        std::int64_t                            position;
+        std::chrono::steady_clock::time_point   read_time;
+    };
+    std::deque<packet_read_mark> packet_read_marks;
+    std::int64_t            next_read_position;     // continues packets without pts
+
+    audio_demuxer_stats     demuxer_stats;
+    audio_progress_callback progress_callback;
+    std::chrono::milliseconds progress_interval;
+    std::chrono::steady_clock::time_point last_progress;
 
     void clean_up_resources();
-    std::error_code open_codec_context(enum AVMediaType type = AVMEDIA_TYPE_AUDIO);
+    std::error_code open_conversion(audio_sink_obj &sink);
+    std::error_code open_stages(audio_sink_obj &sink);
+    std::error_code open_decoding();
+    std::unique_ptr<audio_demuxer_obj> create_stream_conversion(int sample_rate_hz,
+                                                                AVSampleFormat format,
+                                                                int64_t ch_layout);
+    // frame_source: decoder of the demuxer that hands over decoded frames instead of packets
+    std::error_code open_stream_conversion(AVFormatContext *shared_fmt_ctx,
+                                           int stream_index,
+                                           audio_sink_obj &sink,
+                                           const AVCodecContext *frame_source = nullptr);
+    std::error_code convert_packet(const AVPacket *current_packet);
+    // read_result: what ended the input, the seek index is saved only after AVERROR_EOF
+    std::error_code flush_conversion(int read_result);
+    std::error_code finish_conversion(std::error_code result);
+    void release_conversion_state();
+    // reserves the limits of count child conversions from the budget at once
+    std::error_code admit_child_conversions(std::size_t count);
+    void release_child_admissions(std::size_t count);
+    std::error_code check_memory_budget();
+    // -1 picks the best audio stream
+    std::error_code open_codec_context(int stream_index = -1);
     std::error_code get_input_file_info();
-    std::error_code init_resampler();
-    std::error_code decode_packet(const AVPacket *current_packet, std::fstream &out_stream);
-    static void output_data(std::fstream &out_fs,
-                            std::vector<std::vector<uint8_t> > &data_storage,
-                            int data_size);
+    std::error_code open_custom_io();
+    std::error_code init_resampler(const AVCodecContext *source_ctx);
+    // handler(in_frame) per decoded frame, stops early once the range is done
+    template<typename Handler>
+    std::error_code decode_frames(const AVPacket *current_packet, Handler &&handler);
+    std::error_code decode_packet(const AVPacket *current_packet, audio_sink_obj &sink);
+    std::error_code convert_frame(AVFrame *frame, audio_sink_obj &sink);
+    std::error_code passthrough_packet(const AVPacket *current_packet, audio_sink_obj &sink);
+    std::error_code flush_resampler(audio_sink_obj &sink);
+    std::error_code run_pipelined(audio_sink_obj &sink);
+    // reads the sidecar of the source file ahead of the probe
+    bool preload_seek_index();
+    void load_seek_index();
+    void add_seek_index_entry(const AVPacket *current_packet);
+    bool seek_by_index(int64_t target_sample);
+    // av_read_frame, after a byte seek the verified packet comes first
+    int read_packet(AVPacket *target);
+    void seek_to_range_start();
+    std::error_code output_samples(int64_t frame_pts,
+                                   std::span<const std::span<const uint8_t> > planes,
+                                   int64_t nb_samples,
+                                   audio_sink_obj &sink);
+    void report_progress();
+    void mark_packet_read(const AVPacket *current_packet);
+    void record_latency(int64_t first_sample);
 
 };
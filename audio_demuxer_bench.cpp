@@ -0,0 +1,672 @@
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <benchmark/benchmark.h>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include "audio_demuxer.h"
+#include "audio_async.h"
+
+// micro and macro benchmarks for the resampler and the demuxer
+// machine-readable output: audio_demuxer_bench --benchmark_format=json
+
+// allocation counting
+
+namespace {
+
+std::atomic<std::uint64_t> allocations_amount {0};
+
+}
+
+#if defined(__GLIBC__)
+
+// glibc's allocator is wrapped, so every heap allocation of the process is
+// counted: operator new, av_malloc / av_buffer (posix_memalign), swr, libc
+
+extern "C" {
+
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t nb, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(std::size_t size) noexcept {
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t nb, std::size_t size) noexcept {
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(nb, size);
+}
+
+void *realloc(void *ptr, std::size_t size) noexcept {
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) noexcept {
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, std::size_t alignment, std::size_t size) noexcept {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr == nullptr && size != 0 ? ENOMEM : 0;
+}
+
+void free(void *ptr) noexcept {
+    __libc_free(ptr);
+}
+
+}
+
+#else
+
+// without glibc only the C++ heap is seen, FFmpeg's allocations are missing
+// from allocs_per_frame
+
+void *operator new(std::size_t size) {
+    allocations_amount.fetch_add(1, std::memory_order_relaxed);
+    if (auto *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif
+
+namespace {
+
+double peak_rss_mib() {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_maxrss) / 1024.0;
+}
+
+// test signal
+
+constexpr double tone_hz = 440.0;
+
+void fill_sine(AVFrame *frame, int channels, int64_t first_sample) {
+    auto format = static_cast<AVSampleFormat>(frame->format);
+    auto planar = av_sample_fmt_is_planar(format) != 0;
+    auto packed_format = av_get_packed_sample_fmt(format);
+
+    for (int i = 0; i < frame->nb_samples; ++i) {
+        auto t = static_cast<double>(first_sample + i) / frame->sample_rate;
+        auto value = 0.5 * std::sin(2.0 * M_PI * tone_hz * t);
+        for (int ch = 0; ch < channels; ++ch) {
+            auto plane = planar ? ch : 0;
+            auto index = planar ? i : i * channels + ch;
+            switch (packed_format) {
+                case AV_SAMPLE_FMT_S16:
+                    reinterpret_cast<int16_t *>(frame->data[plane])[index] = static_cast<int16_t>(value * INT16_MAX);
+                    break ;
+                case AV_SAMPLE_FMT_S32:
+                    reinterpret_cast<int32_t *>(frame->data[plane])[index] = static_cast<int32_t>(value * INT32_MAX);
+                    break ;
+                case AV_SAMPLE_FMT_FLT:
+                    reinterpret_cast<float *>(frame->data[plane])[index] = static_cast<float>(value);
+                    break ;
+                case AV_SAMPLE_FMT_DBL:
+                    reinterpret_cast<double *>(frame->data[plane])[index] = value;
+                    break ;
+                default:
+                    break ;
+            }
+        }
+    }
+}
+
+AVFrame *alloc_frame(AVSampleFormat format, int sample_rate, int64_t ch_layout, int nb_samples) {
+    auto *frame = av_frame_alloc();
+    if (frame == nullptr) {
+        return nullptr;
+    }
+    frame->format = format;
+    frame->sample_rate = sample_rate;
+    frame->channel_layout = static_cast<uint64_t>(ch_layout);
+    frame->channels = av_get_channel_layout_nb_channels(static_cast<uint64_t>(ch_layout));
+    frame->nb_samples = nb_samples;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+// synthetic media, generated once per run into the temp directory
+
+struct bench_media {
+    const char  *name;
+    const char  *encoder;
+    const char  *container;
+    const char  *extension;
+    int         sample_rate;
+    int64_t     ch_layout;
+    double      seconds;
+};
+
+// the hour long input is only used by the output comparison, the decode
+// benchmarks run over the first bench_decode_media entries
+const std::vector<bench_media> bench_media_list = {
+    {"aac_mp4",     "aac",        "mp4",      "mp4", 44100, AV_CH_LAYOUT_STEREO, 60.0},
+    {"mp3_mkv",     "libmp3lame", "matroska", "mkv", 44100, AV_CH_LAYOUT_STEREO, 60.0},
+    {"opus_ogg",    "libopus",    "ogg",      "ogg", 48000, AV_CH_LAYOUT_STEREO, 60.0},
+    {"flac_mkv",    "flac",       "matroska", "mkv", 48000, AV_CH_LAYOUT_STEREO, 60.0},
+    {"pcm_wav",     "pcm_s16le",  "wav",      "wav", 16000, AV_CH_LAYOUT_MONO,   60.0},
+    {"pcm_wav_1h",  "pcm_s16le",  "wav",      "wav", 16000, AV_CH_LAYOUT_MONO,   3600.0},
+};
+constexpr int64_t bench_decode_media = 5;
+
+std::filesystem::path bench_dir() {
+    auto dir = std::filesystem::temp_directory_path() / "audio_demuxer_bench";
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+bool write_packets(AVCodecContext *encoder_ctx, AVFormatContext *out_fmt_ctx, AVStream *stream, const AVFrame *frame) {
+    if (avcodec_send_frame(encoder_ctx, frame) < 0) {
+        return false;
+    }
+    auto *out_packet = av_packet_alloc();
+    if (out_packet == nullptr) {
+        return false;
+    }
+    auto ok = true;
+    while (avcodec_receive_packet(encoder_ctx, out_packet) >= 0) {
+        av_packet_rescale_ts(out_packet, encoder_ctx->time_base, stream->time_base);
+        out_packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(out_fmt_ctx, out_packet) < 0) {
+            ok = false;
+            break ;
+        }
+    }
+    av_packet_free(&out_packet);
+    return ok;
+}
+
+bool encode_media(const bench_media &media, const std::filesystem::path &path) {
+    const AVCodec *encoder = avcodec_find_encoder_by_name(media.encoder);
+    if (encoder == nullptr) {
+        return false;
+    }
+
+    AVFormatContext *out_fmt_ctx = nullptr;
+    if (avformat_alloc_output_context2(&out_fmt_ctx, nullptr, media.container, path.c_str()) < 0) {
+        return false;
+    }
+    auto *stream = avformat_new_stream(out_fmt_ctx, nullptr);
+    auto *encoder_ctx = avcodec_alloc_context3(encoder);
+    auto ok = stream != nullptr && encoder_ctx != nullptr;
+
+    AVFrame *frame = nullptr;
+    if (ok) {
+        encoder_ctx->sample_fmt = encoder->sample_fmts != nullptr ? encoder->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+        encoder_ctx->sample_rate = media.sample_rate;
+        encoder_ctx->channel_layout = static_cast<uint64_t>(media.ch_layout);
+        encoder_ctx->channels = av_get_channel_layout_nb_channels(static_cast<uint64_t>(media.ch_layout));
+        encoder_ctx->bit_rate = 128000;
+        encoder_ctx->time_base = av_make_q(1, media.sample_rate);
+        if (out_fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+            encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        ok = avcodec_open2(encoder_ctx, encoder, nullptr) >= 0 &&
+             avcodec_parameters_from_context(stream->codecpar, encoder_ctx) >= 0;
+    }
+    if (ok) {
+        stream->time_base = encoder_ctx->time_base;
+        ok = avio_open(&out_fmt_ctx->pb, path.c_str(), AVIO_FLAG_WRITE) >= 0 &&
+             avformat_write_header(out_fmt_ctx, nullptr) >= 0;
+    }
+    if (ok) {
+        auto frame_size = encoder_ctx->frame_size > 0 ? encoder_ctx->frame_size : 1024;
+        frame = alloc_frame(encoder_ctx->sample_fmt, media.sample_rate, media.ch_layout, frame_size);
+        ok = frame != nullptr;
+
+        auto total_samples = static_cast<int64_t>(media.seconds * media.sample_rate);
+        for (int64_t pts = 0; ok && pts < total_samples; pts += frame_size) {
+            ok = av_frame_make_writable(frame) >= 0;
+            fill_sine(frame, encoder_ctx->channels, pts);
+            frame->pts = pts;
+            ok = ok && write_packets(encoder_ctx, out_fmt_ctx, stream, frame);
+        }
+        ok = ok && write_packets(encoder_ctx, out_fmt_ctx, stream, nullptr);
+        ok = ok && av_write_trailer(out_fmt_ctx) >= 0;
+    }
+
+    av_frame_free(&frame);
+    avcodec_free_context(&encoder_ctx);
+    if (out_fmt_ctx->pb != nullptr) {
+        avio_closep(&out_fmt_ctx->pb);
+    }
+    avformat_free_context(out_fmt_ctx);
+
+    return ok;
+}
+
+// empty path when the encoder isn't available in this FFmpeg build
+std::filesystem::path bench_media_file(const bench_media &media) {
+    auto path = bench_dir() / (std::string(media.name) + "." + media.extension);
+    if (std::filesystem::exists(path)) {
+        return path;
+    }
+    if (!encode_media(media, path)) {
+        std::filesystem::remove(path);
+        return {};
+    }
+    return path;
+}
+
+// sink that only counts, keeps the output cost out of the decode measurements
+class null_sink_obj final : public audio_sink_obj {
+public:
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int) override {
+        for (auto & item : planes) {
+            bytes += item.size();
+        }
+        ++frames;
+        return {};
+    }
+
+    std::uint64_t bytes = 0;
+    std::uint64_t frames = 0;
+};
+
+void set_common_counters(benchmark::State &state, double audio_seconds, double frames, std::uint64_t allocations) {
+    state.counters["audio_s_per_s"] = benchmark::Counter(audio_seconds, benchmark::Counter::kIsRate);
+    state.counters["allocs_per_frame"] = frames > 0 ? static_cast<double>(allocations) / frames : 0.0;
+    state.counters["peak_rss_mib"] = peak_rss_mib();
+}
+
+}
+
+// micro: audio_resampler_obj::convert
+// args: src format, src rate, src layout, dst format, dst rate, dst layout, fast path allowed
+
+static void BM_resampler_convert(benchmark::State &state) {
+    auto src_fmt = static_cast<AVSampleFormat>(state.range(0));
+    auto src_rate = static_cast<int>(state.range(1));
+    auto src_layout = state.range(2);
+    auto dst_fmt = static_cast<AVSampleFormat>(state.range(3));
+    auto dst_rate = static_cast<int>(state.range(4));
+    auto dst_layout = state.range(5);
+    auto allow_fast_path = state.range(6) != 0;
+    constexpr int frame_samples = 1024;
+
+    auto resampler = audio_resampler_obj::create_audio_resampler_obj(src_layout, src_rate, src_fmt,
+                                                                     dst_layout, dst_rate, dst_fmt,
+                                                                     allow_fast_path);
+    auto *frame = alloc_frame(src_fmt, src_rate, src_layout, frame_samples);
+    if (resampler == nullptr || frame == nullptr) {
+        av_frame_free(&frame);
+        state.SkipWithError("could not init the resampler");
+        return;
+    }
+    fill_sine(frame, av_get_channel_layout_nb_channels(static_cast<uint64_t>(src_layout)), 0);
+
+    // warm-up, grows the dst buffers to their final size
+    resampler->convert(frame);
+    auto allocations_before = allocations_amount.load();
+    auto dst_allocs_before = resampler->get_dst_alloc_count();
+
+    for (auto _ : state) {
+        if (resampler->convert(frame) != audio_resampler_err::SUCCESS) {
+            state.SkipWithError("convert failed");
+            break ;
+        }
+        benchmark::DoNotOptimize(resampler->get_output_planes().data());
+    }
+
+    auto frames = static_cast<double>(state.iterations());
+    set_common_counters(state,
+                        frames * frame_samples / src_rate,
+                        frames,
+                        allocations_amount.load() - allocations_before);
+    state.counters["dst_reallocs"] = static_cast<double>(resampler->get_dst_alloc_count() - dst_allocs_before);
+    state.SetItemsProcessed(state.iterations() * frame_samples);
+    state.SetLabel(resampler->get_backend_name());
+    av_frame_free(&frame);
+}
+BENCHMARK(BM_resampler_convert)
+        ->ArgNames({"src_fmt", "src_rate", "src_ch", "dst_fmt", "dst_rate", "dst_ch", "fast"})
+        // 44.1k -> 16k, fltp stereo -> s16 mono
+        ->Args({AV_SAMPLE_FMT_FLTP, 44100, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 0})
+        ->Args({AV_SAMPLE_FMT_FLTP, 44100, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 1})
+        // 48k -> 16k, fltp stereo -> s16 mono
+        ->Args({AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 0})
+        ->Args({AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 1})
+        // fltp -> s16, rate and layout unchanged
+        ->Args({AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 48000, AV_CH_LAYOUT_STEREO, 0})
+        ->Args({AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 48000, AV_CH_LAYOUT_STEREO, 1})
+        // stereo -> mono only
+        ->Args({AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 0})
+        ->Args({AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 1})
+        // 8k -> 16k upsampling
+        ->Args({AV_SAMPLE_FMT_S16, 8000, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 0})
+        ->Args({AV_SAMPLE_FMT_S16, 8000, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO, 1});
+
+// accuracy of the fast path: SNR of its output against swr on the bench tone,
+// which sits inside the passband, for every kernel set the cpu runs; reported
+// as snr_db_<kernels>, a set below min_fast_resampler_snr_db fails the run
+// args: src format, src rate, src layout
+
+constexpr double min_fast_resampler_snr_db = 70.0;
+
+static void BM_fast_resampler_snr(benchmark::State &state) {
+    auto src_fmt = static_cast<AVSampleFormat>(state.range(0));
+    auto src_rate = static_cast<int>(state.range(1));
+    auto src_layout = state.range(2);
+    constexpr int frame_samples = 1024;
+    constexpr int dst_rate = 16000;
+    auto channels = av_get_channel_layout_nb_channels(static_cast<uint64_t>(src_layout));
+
+    auto *frame = alloc_frame(src_fmt, src_rate, src_layout, frame_samples);
+    if (frame == nullptr) {
+        state.SkipWithError("could not allocate the frame");
+        return;
+    }
+
+    std::string failed;
+    for (auto _ : state) {
+        auto reference = audio_resampler_obj::create_audio_resampler_obj(src_layout, src_rate, src_fmt,
+                                                                         AV_CH_LAYOUT_MONO, dst_rate, AV_SAMPLE_FMT_S16,
+                                                                         false);
+        if (reference == nullptr) {
+            state.SkipWithError("could not create the swr resampler");
+            break ;
+        }
+        std::vector<int16_t> expected;
+        for (int64_t first = 0; first < src_rate * 2; first += frame_samples) {
+            fill_sine(frame, channels, first);
+            reference->convert(frame);
+            auto *samples = reinterpret_cast<const int16_t *>(reference->get_output_planes()[0].data());
+            expected.insert(expected.end(), samples, samples + reference->get_output_nb_samples());
+        }
+
+        for (const auto *kernels : get_supported_audio_simd_kernels()) {
+            auto fast = audio_fast_resampler_obj::create_audio_fast_resampler_obj(src_layout, src_rate, src_fmt,
+                                                                                  AV_CH_LAYOUT_MONO, dst_rate, AV_SAMPLE_FMT_S16,
+                                                                                  *kernels);
+            if (fast == nullptr) {
+                failed = "no fast path for this conversion";
+                break ;
+            }
+            std::vector<int16_t> output;
+            std::vector<int16_t> buffer;
+            for (int64_t first = 0; first < src_rate * 2; first += frame_samples) {
+                fill_sine(frame, channels, first);
+                buffer.resize(static_cast<size_t>(fast->get_max_output_samples(frame_samples)));
+                auto nb_out = fast->convert(frame->extended_data, frame_samples, buffer.data(), static_cast<int>(buffer.size()));
+                output.insert(output.end(), buffer.begin(), buffer.begin() + nb_out);
+            }
+
+            // both start at the same output position, swr keeps a few more samples buffered
+            double signal = 0.0;
+            double noise = 0.0;
+            auto nb_samples = std::min(expected.size(), output.size());
+            for (size_t i = 0; i < nb_samples; ++i) {
+                auto value = static_cast<double>(expected[i]);
+                auto difference = value - output[i];
+                signal += value * value;
+                noise += difference * difference;
+            }
+            auto snr_db = noise > 0.0 ? 10.0 * std::log10(signal / noise) : 200.0;
+            state.counters[std::string("snr_db_") + kernels->name] = snr_db;
+            if (nb_samples == 0 || snr_db < min_fast_resampler_snr_db) {
+                failed = std::string(kernels->name) + " kernels below the SNR threshold";
+            }
+        }
+    }
+
+    if (!failed.empty()) {
+        state.SkipWithError(failed.c_str());
+    }
+    state.SetLabel(get_audio_simd_kernels().name);
+    av_frame_free(&frame);
+}
+BENCHMARK(BM_fast_resampler_snr)
+        ->ArgNames({"src_fmt", "src_rate", "src_ch"})
+        // every input the fast path covers, to 16k s16 mono
+        ->Args({AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_STEREO})
+        ->Args({AV_SAMPLE_FMT_FLTP, 44100, AV_CH_LAYOUT_STEREO})
+        ->Args({AV_SAMPLE_FMT_FLTP, 16000, AV_CH_LAYOUT_STEREO})
+        ->Args({AV_SAMPLE_FMT_FLTP, 48000, AV_CH_LAYOUT_MONO})
+        ->Args({AV_SAMPLE_FMT_FLT, 22050, AV_CH_LAYOUT_MONO})
+        ->Args({AV_SAMPLE_FMT_S16, 8000, AV_CH_LAYOUT_MONO})
+        ->Args({AV_SAMPLE_FMT_S16, 16000, AV_CH_LAYOUT_MONO})
+        ->Iterations(1);
+
+// micro: audio_dsp_stage_obj on 16k s16 mono, the cost to compare with decode time
+// args: gain mode, silence dropping
+
+static void BM_dsp_stage(benchmark::State &state) {
+    constexpr int sample_rate = 16000;
+    constexpr int frame_samples = 1024;
+
+    audio_dsp_options options;
+    options.enabled = true;
+    options.gain_mode = static_cast<audio_gain_mode>(state.range(0));
+    options.drop_silence = state.range(1) != 0;
+
+    auto *frame = alloc_frame(AV_SAMPLE_FMT_S16, sample_rate, AV_CH_LAYOUT_MONO, frame_samples);
+    if (frame == nullptr) {
+        state.SkipWithError("could not allocate the frame");
+        return;
+    }
+    fill_sine(frame, 1, 0);
+    std::span<const uint8_t> plane(frame->data[0], frame_samples * sizeof(int16_t));
+
+    null_sink_obj sink;
+    auto stage = audio_dsp_stage_obj::create_audio_dsp_stage_obj(options, sample_rate, AV_SAMPLE_FMT_S16, 1, sink);
+    for (auto _ : state) {
+        if (stage->consume(std::span(&plane, 1), frame_samples)) {
+            state.SkipWithError("consume failed");
+            break ;
+        }
+    }
+
+    auto frames = static_cast<double>(state.iterations());
+    state.counters["audio_s_per_s"] = benchmark::Counter(frames * frame_samples / sample_rate, benchmark::Counter::kIsRate);
+    state.SetItemsProcessed(state.iterations() * frame_samples);
+    av_frame_free(&frame);
+}
+BENCHMARK(BM_dsp_stage)
+        ->ArgNames({"gain", "drop_silence"})
+        ->Args({static_cast<int64_t>(audio_gain_mode::rms), 0})
+        ->Args({static_cast<int64_t>(audio_gain_mode::ebu_r128), 0})
+        ->Args({static_cast<int64_t>(audio_gain_mode::ebu_r128), 1});
+
+// micro: audio_chunker_obj re-chunking decoder sized blocks of 16k s16 mono
+// args: window, hop (samples)
+
+static void BM_chunker(benchmark::State &state) {
+    constexpr int sample_rate = 16000;
+    constexpr int frame_samples = 1024;
+
+    audio_chunk_options options;
+    options.enabled = true;
+    options.window_samples = static_cast<int>(state.range(0));
+    options.hop_samples = static_cast<int>(state.range(1));
+
+    std::vector<int16_t> samples(frame_samples);
+    std::span<const uint8_t> plane(reinterpret_cast<const uint8_t *>(samples.data()), samples.size() * sizeof(int16_t));
+
+    null_sink_obj sink;
+    auto chunker = audio_chunker_obj::create_audio_chunker_obj(options, AV_SAMPLE_FMT_S16, 1, sink);
+    for (auto _ : state) {
+        if (chunker->consume(std::span(&plane, 1), frame_samples)) {
+            state.SkipWithError("consume failed");
+            break ;
+        }
+    }
+
+    auto frames = static_cast<double>(state.iterations());
+    state.counters["audio_s_per_s"] = benchmark::Counter(frames * frame_samples / sample_rate, benchmark::Counter::kIsRate);
+    state.counters["windows"] = static_cast<double>(chunker->get_windows());
+    state.SetItemsProcessed(state.iterations() * frame_samples);
+}
+BENCHMARK(BM_chunker)
+        ->ArgNames({"window", "hop"})
+        ->Args({400, 160})
+        ->Args({16000, 16000})
+        ->Args({480000, 400000});
+
+// macro: audio_demuxer_obj::convert end to end into a null sink
+// args: media index, decoder thread count
+
+static void BM_demuxer_convert(benchmark::State &state) {
+    const auto &media = bench_media_list[static_cast<size_t>(state.range(0))];
+    state.SetLabel(media.name);
+    auto path = bench_media_file(media);
+    if (path.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+
+    audio_decoder_options decoder_options;
+    decoder_options.thread_count = static_cast<int>(state.range(1));
+
+    double audio_seconds = 0.0;
+    double frames = 0.0;
+    std::uint64_t allocations = 0;
+    for (auto _ : state) {
+        auto transcoder = audio_demuxer_obj(path, 16000, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_MONO, decoder_options);
+        null_sink_obj sink;
+        auto allocations_before = allocations_amount.load();
+        auto result = transcoder.convert(sink);
+        allocations += allocations_amount.load() - allocations_before;
+        if (result != audio_demuxer_errc::SUCCESS) {
+            state.SkipWithError(result.message().c_str());
+            break ;
+        }
+        audio_seconds += static_cast<double>(transcoder.get_converted_samples()) / 16000;
+        frames += static_cast<double>(sink.frames);
+    }
+
+    set_common_counters(state, audio_seconds, frames, allocations);
+}
+BENCHMARK(BM_demuxer_convert)
+        ->ArgNames({"media", "threads"})
+        ->ArgsProduct({benchmark::CreateDenseRange(0, bench_decode_media - 1, 1), {1, 0}})
+        ->Unit(benchmark::kMillisecond);
+
+// macro: file output through the fstream sink vs the batched pwrite writer,
+// on a minute of aac and on a minute and an hour of 16k pcm
+// args: media index, 0 = fstream, 1 = pcm writer
+
+static void BM_demuxer_output(benchmark::State &state) {
+    const auto &media = bench_media_list[static_cast<size_t>(state.range(0))];
+    auto use_writer = state.range(1) != 0;
+    state.SetLabel(std::string(media.name) + (use_writer ? "/pcm_writer" : "/fstream"));
+    auto path = bench_media_file(media);
+    if (path.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+    auto out_path = bench_dir() / "output.raw";
+
+    double audio_seconds = 0.0;
+    for (auto _ : state) {
+        auto transcoder = audio_demuxer_obj(path, 16000, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_MONO);
+        std::error_code result;
+        if (use_writer) {
+            result = transcoder.convert(out_path);
+        } else {
+            std::fstream fs_out(out_path, std::ios::out | std::ios::binary | std::ios::trunc);
+            audio_fstream_sink_obj sink(fs_out);
+            result = transcoder.convert(sink);
+        }
+        if (result != audio_demuxer_errc::SUCCESS) {
+            state.SkipWithError(result.message().c_str());
+            break ;
+        }
+        audio_seconds += static_cast<double>(transcoder.get_converted_samples()) / 16000;
+    }
+    std::filesystem::remove(out_path);
+
+    state.counters["audio_s_per_s"] = benchmark::Counter(audio_seconds, benchmark::Counter::kIsRate);
+    state.counters["peak_rss_mib"] = peak_rss_mib();
+}
+BENCHMARK(BM_demuxer_output)
+        ->ArgNames({"media", "writer"})
+        ->ArgsProduct({{0, 4, 5}, {0, 1}})
+        ->Unit(benchmark::kMillisecond);
+
+// macro: many coroutine conversions in flight on a two thread pool
+// args: media index, conversions in flight
+
+static void BM_async_convert(benchmark::State &state) {
+    const auto &media = bench_media_list[static_cast<size_t>(state.range(0))];
+    state.SetLabel(media.name);
+    auto path = bench_media_file(media);
+    if (path.empty()) {
+        state.SkipWithError("encoder not available");
+        return;
+    }
+    auto nb_conversions = static_cast<size_t>(state.range(1));
+
+    double audio_seconds = 0.0;
+    for (auto _ : state) {
+        std::vector<std::unique_ptr<audio_demuxer_obj> > transcoders;
+        std::vector<null_sink_obj> sinks(nb_conversions);
+        std::atomic<size_t> failures(0);
+        boost::asio::thread_pool pool(2);
+        for (size_t i = 0; i < nb_conversions; ++i) {
+            transcoders.push_back(std::make_unique<audio_demuxer_obj>(path, 16000, AV_SAMPLE_FMT_S16, AV_CH_LAYOUT_MONO));
+            boost::asio::co_spawn(pool,
+                                  async_convert(*transcoders.back(), sinks[i]),
+                                  [&failures](std::exception_ptr, std::error_code result) {
+                                      if (result) {
+                                          ++failures;
+                                      }
+                                  });
+        }
+        pool.join();
+        if (failures > 0) {
+            state.SkipWithError("conversion failed");
+            break ;
+        }
+        for (auto & item : transcoders) {
+            audio_seconds += static_cast<double>(item->get_converted_samples()) / 16000;
+        }
+    }
+
+    state.counters["audio_s_per_s"] = benchmark::Counter(audio_seconds, benchmark::Counter::kIsRate);
+    state.counters["peak_rss_mib"] = peak_rss_mib();
+}
+BENCHMARK(BM_async_convert)
+        ->ArgNames({"media", "in_flight"})
+        ->ArgsProduct({{0}, {1, 16, 256}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+BENCHMARK_MAIN();
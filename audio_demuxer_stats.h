@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// per-conversion counters, filled while converting and kept until the next convert
+// build with AUDIO_DEMUXER_NO_STATS to compile the instrumentation out
+
+struct audio_demuxer_stats {
+    // cumulative time per stage
+    std::uint64_t   read_ns = 0;        // av_read_frame
+    std::uint64_t   decode_ns = 0;      // avcodec_send_packet / avcodec_receive_frame
+    std::uint64_t   resample_ns = 0;    // swr_convert
+    std::uint64_t   output_ns = 0;      // sink
+
+    std::uint64_t   packets = 0;
+    std::uint64_t   frames = 0;
+    std::uint64_t   samples_in = 0;     // decoded samples per channel
+    std::uint64_t   samples_out = 0;    // samples per channel handed to the sink
+    std::uint64_t   bytes_in = 0;       // packet payload
+    std::uint64_t   bytes_out = 0;      // converted PCM
+    std::uint64_t   allocations = 0;    // resampler buffer (re)allocations
+    std::uint64_t   memory_peak = 0;    // bytes in use in the memory arena at most
+};
+
+// adds the counters of a part of the conversion (a pipeline stage, a stream)
+inline void audio_stats_merge(audio_demuxer_stats &stats, const audio_demuxer_stats &part) {
+    stats.read_ns += part.read_ns;
+    stats.decode_ns += part.decode_ns;
+    stats.resample_ns += part.resample_ns;
+    stats.output_ns += part.output_ns;
+    stats.packets += part.packets;
+    stats.frames += part.frames;
+    stats.samples_in += part.samples_in;
+    stats.samples_out += part.samples_out;
+    stats.bytes_in += part.bytes_in;
+    stats.bytes_out += part.bytes_out;
+    stats.allocations += part.allocations;
+    stats.memory_peak += part.memory_peak;
+}
+
+using audio_progress_callback = std::function<void(const audio_demuxer_stats &)>;
+
+#ifdef AUDIO_DEMUXER_NO_STATS
+
+#define AUDIO_STATS_START(name)
+#define AUDIO_STATS_STOP(counter, name)
+#define AUDIO_STATS_ADD(counter, value)
+
+#else
+
+inline std::chrono::steady_clock::time_point audio_stats_now() {
+    return std::chrono::steady_clock::now();
+}
+
+inline std::uint64_t audio_stats_since(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+#define AUDIO_STATS_START(name) auto name = audio_stats_now()
+#define AUDIO_STATS_STOP(counter, name) (counter) += audio_stats_since(name)
+#define AUDIO_STATS_ADD(counter, value) (counter) += static_cast<std::uint64_t>(value)
+
+#endif
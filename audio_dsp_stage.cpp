@@ -0,0 +1,359 @@
+#include "audio_dsp_stage.h"
+#include "audio_demuxer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// absolute gate of BS.1770, quieter frames do not move the running level
+constexpr double level_gate_db = -70.0;
+
+double to_db(double mean_square) {
+    return 10.0 * std::log10(std::max(mean_square, 1e-20));
+}
+
+// sum of squares on the dot kernel, the tail after the last 16 samples is scalar
+double sum_squares(const audio_simd_kernels &kernels, const float *data, size_t nb_values) {
+    auto vector_values = nb_values / 16 * 16;
+    double sum = vector_values > 0 ? kernels.dot(data, data, static_cast<int>(vector_values)) : 0.0;
+    for (auto i = vector_values; i < nb_values; ++i) {
+        sum += static_cast<double>(data[i]) * data[i];
+    }
+    return sum;
+}
+
+}
+
+// public methods
+
+std::unique_ptr<audio_dsp_stage_obj> audio_dsp_stage_obj::create_audio_dsp_stage_obj(const audio_dsp_options &options,
+                                                                                     int sample_rate,
+                                                                                     AVSampleFormat sample_fmt,
+                                                                                     int nb_channels,
+                                                                                     audio_sink_obj &downstream,
+                                                                                     std::pmr::memory_resource *resource) {
+    auto packed_fmt = av_get_packed_sample_fmt(sample_fmt);
+    if (packed_fmt != AV_SAMPLE_FMT_S16 && packed_fmt != AV_SAMPLE_FMT_FLT) {
+        return nullptr;
+    }
+    if (sample_rate <= 0 || nb_channels <= 0 || options.frame_ms <= 0) {
+        return nullptr;
+    }
+
+    return std::make_unique<audio_dsp_stage_obj>(options, sample_rate, sample_fmt, nb_channels, downstream, resource);
+}
+
+audio_dsp_stage_obj::audio_dsp_stage_obj(const audio_dsp_options &options,
+                                         int sample_rate,
+                                         AVSampleFormat sample_fmt,
+                                         int nb_channels,
+                                         audio_sink_obj &downstream,
+                                         std::pmr::memory_resource *resource) :
+        opts(options),
+        rate(sample_rate),
+        channels(nb_channels),
+        s16(av_get_packed_sample_fmt(sample_fmt) == AV_SAMPLE_FMT_S16),
+        planar(av_sample_fmt_is_planar(sample_fmt) != 0),
+        frame_samples(std::max(sample_rate * options.frame_ms / 1000, 1)),
+        sample_size(static_cast<size_t>(av_get_bytes_per_sample(sample_fmt))),
+        frame_bytes(static_cast<size_t>(frame_samples) * static_cast<size_t>(nb_channels) * sample_size),
+        interleaved(resource),
+        pending(resource),
+        frame_float(resource),
+        frame_out(resource),
+        k_state(static_cast<size_t>(nb_channels)),
+        level_ms(0.0),
+        level_known(false),
+        gain(1.0),
+        silence_frames(resource),
+        silence_capacity(0),
+        silence_head(0),
+        silence_count(0),
+        pad_frames(0),
+        speech_seen(false),
+        head_pad_done(false),
+        input_position(0),
+        output_position(0),
+        sink(downstream),
+        kernels(get_audio_simd_kernels()) {
+
+    pending.reserve(frame_bytes);
+    frame_float.resize(static_cast<size_t>(frame_samples) * static_cast<size_t>(channels));
+    frame_out.resize(frame_bytes);
+
+    // K-weighting (BS.1770): high shelf then RLB high-pass, coefficients for this rate
+    auto k = std::tan(M_PI * 1681.974450955533 / rate);
+    auto q = 0.7071752369554196;
+    auto vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    auto vb = std::pow(vh, 0.4996667741545416);
+    auto a0 = 1.0 + k / q + k * k;
+    k_filter[0] = {(vh + vb * k / q + k * k) / a0,
+                   2.0 * (k * k - vh) / a0,
+                   (vh - vb * k / q + k * k) / a0,
+                   2.0 * (k * k - 1.0) / a0,
+                   (1.0 - k / q + k * k) / a0};
+    k = std::tan(M_PI * 38.13547087602444 / rate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    k_filter[1] = {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    if (opts.drop_silence) {
+        auto frame_ms = static_cast<size_t>(opts.frame_ms);
+        pad_frames = static_cast<size_t>(std::max(opts.keep_silence_ms, 0)) / frame_ms;
+        silence_capacity = std::max(static_cast<size_t>(std::max(opts.min_silence_ms, 0)) / frame_ms, 2 * pad_frames);
+        silence_capacity = std::max<size_t>(silence_capacity, 1);
+        silence_frames.resize(silence_capacity * frame_bytes);
+        silence_positions.resize(silence_capacity);
+        silence_sizes.resize(silence_capacity);
+    }
+}
+
+std::error_code audio_dsp_stage_obj::consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    if (nb_samples <= 0 || planes.empty()) {
+        return audio_demuxer_errc::SUCCESS;
+    }
+
+    std::span<const uint8_t> data = planes[0];
+    if (planar && planes.size() > 1) {
+        interleaved.resize(planes.size() * planes[0].size());
+        audio_interleave_planes(planes, nb_samples, sample_size, interleaved.data());
+        data = interleaved;
+    }
+
+    // complete the pending frame first, then whole frames straight from the input
+    if (!pending.empty()) {
+        auto chunk = std::min(frame_bytes - pending.size(), data.size());
+        pending.insert(pending.end(), data.begin(), data.begin() + static_cast<std::ptrdiff_t>(chunk));
+        data = data.subspan(chunk);
+        if (pending.size() < frame_bytes) {
+            return audio_demuxer_errc::SUCCESS;
+        }
+        auto result = process_frame(pending.data(), frame_samples);
+        pending.clear();
+        if (result) {
+            return result;
+        }
+    }
+    while (data.size() >= frame_bytes) {
+        auto result = process_frame(data.data(), frame_samples);
+        if (result) {
+            return result;
+        }
+        data = data.subspan(frame_bytes);
+    }
+    pending.insert(pending.end(), data.begin(), data.end());
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_dsp_stage_obj::finish() {
+    if (!pending.empty()) {
+        auto nb_samples = static_cast<int>(pending.size() / (static_cast<size_t>(channels) * sample_size));
+        auto result = process_frame(pending.data(), nb_samples);
+        pending.clear();
+        if (result) {
+            return result;
+        }
+    }
+
+    // trailing silence keeps its head pad after the last speech frame
+    if (speech_seen && !head_pad_done) {
+        auto result = emit_silence_head(std::min(pad_frames, silence_count));
+        if (result) {
+            return result;
+        }
+    }
+    drop_silence_head(silence_count);
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+const std::vector<audio_kept_segment> &audio_dsp_stage_obj::get_kept_segments() const {
+    return kept_segments;
+}
+
+double audio_dsp_stage_obj::get_gain_db() const {
+    return 20.0 * std::log10(gain);
+}
+
+// private methods
+
+std::error_code audio_dsp_stage_obj::process_frame(const uint8_t *data, int nb_samples) {
+    auto nb_values = static_cast<size_t>(nb_samples) * static_cast<size_t>(channels);
+    auto position = input_position;
+    input_position += nb_samples;
+
+    if (s16) {
+        auto *samples = reinterpret_cast<const int16_t *>(data);
+        for (size_t i = 0; i < nb_values; ++i) {
+            frame_float[i] = static_cast<float>(samples[i]) * (1.0f / 32768.0f);
+        }
+    } else {
+        memcpy(frame_float.data(), data, nb_values * sizeof(float));
+    }
+
+    if (opts.gain_mode != audio_gain_mode::none) {
+        apply_gain(nb_samples, measure_level(nb_samples));
+    }
+
+    const uint8_t *out = data;
+    if (opts.gain_mode != audio_gain_mode::none) {
+        if (s16) {
+            kernels.float_to_s16(frame_float.data(), reinterpret_cast<int16_t *>(frame_out.data()), static_cast<int>(nb_values));
+        } else {
+            memcpy(frame_out.data(), frame_float.data(), nb_values * sizeof(float));
+        }
+        out = frame_out.data();
+    }
+
+    if (!opts.drop_silence) {
+        return emit(out, nb_samples, position);
+    }
+
+    auto speech = frame_energy(nb_values) > opts.vad_threshold_dbfs;
+    if (speech) {
+        if (silence_count > 0) {
+            if (!speech_seen || head_pad_done) {
+                // leading silence or the tail of a long one: only the pad before speech
+                drop_silence_head(silence_count - std::min(pad_frames, silence_count));
+            }
+            auto result = emit_silence_head(silence_count);
+            if (result) {
+                return result;
+            }
+        }
+        speech_seen = true;
+        head_pad_done = false;
+        return emit(out, nb_samples, position);
+    }
+
+    // a full ring means a long silence: emit the pad after the last speech once,
+    // then keep only the most recent frames for the pad before the next speech
+    if (silence_count == silence_capacity) {
+        if (speech_seen && !head_pad_done) {
+            auto result = emit_silence_head(pad_frames);
+            if (result) {
+                return result;
+            }
+            head_pad_done = true;
+        }
+        if (silence_count == silence_capacity) {
+            drop_silence_head(1);
+        }
+    }
+    auto slot = (silence_head + silence_count) % silence_capacity;
+    memcpy(silence_frames.data() + slot * frame_bytes, out, nb_values * sample_size);
+    silence_positions[slot] = position;
+    silence_sizes[slot] = nb_samples;
+    ++silence_count;
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+double audio_dsp_stage_obj::measure_level(int nb_samples) {
+    auto nb_values = static_cast<size_t>(nb_samples) * static_cast<size_t>(channels);
+    if (opts.gain_mode == audio_gain_mode::rms) {
+        return sum_squares(kernels, frame_float.data(), nb_values) / static_cast<double>(nb_values);
+    }
+
+    // BS.1770: mean square of the K-weighted signal summed over channels,
+    // the recursive filter runs per channel in sample order
+    double sum = 0.0;
+    for (int ch = 0; ch < channels; ++ch) {
+        auto &state = k_state[static_cast<size_t>(ch)];
+        for (int i = 0; i < nb_samples; ++i) {
+            double value = frame_float[static_cast<size_t>(i * channels + ch)];
+            for (size_t stage = 0; stage < k_filter.size(); ++stage) {
+                auto &f = k_filter[stage];
+                auto &s = state[stage];
+                auto filtered = f.b0 * value + f.b1 * s.x1 + f.b2 * s.x2 - f.a1 * s.y1 - f.a2 * s.y2;
+                s.x2 = s.x1;
+                s.x1 = value;
+                s.y2 = s.y1;
+                s.y1 = filtered;
+                value = filtered;
+            }
+            sum += value * value;
+        }
+    }
+
+    return sum / nb_samples;
+}
+
+void audio_dsp_stage_obj::apply_gain(int nb_samples, double frame_level_ms) {
+    // running level over gain_window_sec, gated so silence does not pull the gain up
+    auto offset = opts.gain_mode == audio_gain_mode::ebu_r128 ? -0.691 : 0.0;
+    if (offset + to_db(frame_level_ms) > level_gate_db) {
+        auto frame_sec = static_cast<double>(nb_samples) / rate;
+        auto alpha = 1.0 - std::exp(-frame_sec / std::max(opts.gain_window_sec, frame_sec));
+        level_ms = level_known ? level_ms + alpha * (frame_level_ms - level_ms) : frame_level_ms;
+        level_known = true;
+    }
+
+    auto target_gain = gain;
+    if (level_known) {
+        auto gain_db = std::clamp(opts.target_level_db - (offset + to_db(level_ms)), -opts.max_gain_db, opts.max_gain_db);
+        target_gain = std::pow(10.0, gain_db / 20.0);
+    }
+
+    // linear ramp across the frame, no steps at frame boundaries
+    auto start = static_cast<float>(gain);
+    auto step = static_cast<float>((target_gain - gain) / nb_samples);
+    for (int i = 0; i < nb_samples; ++i) {
+        auto value = start + step * static_cast<float>(i + 1);
+        auto *frame = frame_float.data() + static_cast<size_t>(i) * static_cast<size_t>(channels);
+        for (int ch = 0; ch < channels; ++ch) {
+            frame[ch] *= value;
+        }
+    }
+    gain = target_gain;
+}
+
+double audio_dsp_stage_obj::frame_energy(size_t nb_values) {
+    // measured after gain, before the rounding to s16
+    return to_db(sum_squares(kernels, frame_float.data(), nb_values) / static_cast<double>(nb_values));
+}
+
+std::error_code audio_dsp_stage_obj::emit(const uint8_t *data, int nb_samples, std::int64_t position) {
+    auto size = static_cast<size_t>(nb_samples) * static_cast<size_t>(channels) * sample_size;
+    std::span<const uint8_t> plane(data, size);
+    auto result = sink.consume(std::span(&plane, 1), nb_samples);
+    if (result) {
+        return result;
+    }
+
+    if (!kept_segments.empty() &&
+        kept_segments.back().input_sample + kept_segments.back().nb_samples == position) {
+        kept_segments.back().nb_samples += nb_samples;
+    } else {
+        kept_segments.push_back({position, output_position, nb_samples});
+    }
+    output_position += nb_samples;
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_dsp_stage_obj::emit_silence_head(size_t nb_frames) {
+    for (size_t i = 0; i < nb_frames && silence_count > 0; ++i) {
+        auto result = emit(silence_frames.data() + silence_head * frame_bytes,
+                           silence_sizes[silence_head],
+                           silence_positions[silence_head]);
+        if (result) {
+            return result;
+        }
+        drop_silence_head(1);
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+void audio_dsp_stage_obj::drop_silence_head(size_t nb_frames) {
+    nb_frames = std::min(nb_frames, silence_count);
+    if (nb_frames == 0) {
+        return;
+    }
+    silence_head = (silence_head + nb_frames) % silence_capacity;
+    silence_count -= nb_frames;
+}
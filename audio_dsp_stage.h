@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+#include "audio_sink.h"
+#include "audio_fast_resampler.h"
+
+// optional processing between the resampler and the sink, fused into the
+// conversion loop so the PCM is not read a second time
+
+enum class audio_gain_mode {
+    none,
+    rms,            // target in dBFS
+    ebu_r128,       // K-weighted loudness, target in LUFS
+};
+
+struct audio_dsp_options {
+    bool            enabled = false;
+    audio_gain_mode gain_mode = audio_gain_mode::none;
+    double          target_level_db = -23.0;
+    double          max_gain_db = 20.0;         // both directions
+    double          gain_window_sec = 3.0;      // time constant of the running level
+    bool            drop_silence = false;
+    double          vad_threshold_dbfs = -40.0; // frame energy after gain
+    int             frame_ms = 20;              // analysis / VAD frame
+    int             min_silence_ms = 500;       // longer silences are cut
+    int             keep_silence_ms = 150;      // silence kept next to speech
+};
+
+// a run of output samples and where it came from, positions are samples per
+// channel counted from the first sample handed to the stage
+
+struct audio_kept_segment {
+    std::int64_t    input_sample;
+    std::int64_t    output_sample;
+    std::int64_t    nb_samples;
+};
+
+// streaming gain + energy VAD + silence dropping for s16 / flt output, planar
+// input leaves the stage interleaved
+// leading and trailing silence is dropped, internal silences longer than
+// min_silence_ms keep keep_silence_ms on each side
+
+class audio_dsp_stage_obj final : public audio_sink_obj {
+public:
+    // nullptr for sample formats other than s16 / flt (packed or planar)
+    // the sample buffers are allocated from resource
+    static std::unique_ptr<audio_dsp_stage_obj> create_audio_dsp_stage_obj(const audio_dsp_options &options,
+                                                                           int sample_rate,
+                                                                           AVSampleFormat sample_fmt,
+                                                                           int nb_channels,
+                                                                           audio_sink_obj &downstream,
+                                                                           std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override;
+    // processes the partial last frame and drops the trailing silence
+    std::error_code finish();
+
+    const std::vector<audio_kept_segment> &get_kept_segments() const;
+    double get_gain_db() const;
+
+    audio_dsp_stage_obj(const audio_dsp_options &options,
+                        int sample_rate,
+                        AVSampleFormat sample_fmt,
+                        int nb_channels,
+                        audio_sink_obj &downstream,
+                        std::pmr::memory_resource *resource);
+
+private:
+
+    // direct form I biquad, one pair (shelf, high-pass) per channel for K-weighting
+    struct biquad {
+        double  b0, b1, b2, a1, a2;
+    };
+    struct biquad_state {
+        double  x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    };
+
+    audio_dsp_options           opts;
+    int                         rate;
+    int                         channels;
+    bool                        s16;
+    bool                        planar;
+    int                         frame_samples;
+    size_t                      sample_size;    // bytes per sample of one channel
+    size_t                      frame_bytes;    // packed
+
+    std::pmr::vector<uint8_t>   interleaved;
+    std::pmr::vector<uint8_t>   pending;        // incomplete frame, packed
+    std::pmr::vector<float>     frame_float;
+    std::pmr::vector<uint8_t>   frame_out;
+
+    // gain
+    std::array<biquad, 2>       k_filter;
+    std::vector<std::array<biquad_state, 2> > k_state;
+    double                      level_ms;       // running mean square
+    bool                        level_known;
+    double                      gain;           // linear, applied at the end of the last frame
+
+    // silence run, ring of whole frames
+    std::pmr::vector<uint8_t>   silence_frames;
+    std::vector<std::int64_t>   silence_positions;
+    std::vector<int>            silence_sizes;
+    size_t                      silence_capacity;
+    size_t                      silence_head;
+    size_t                      silence_count;
+    size_t                      pad_frames;
+    bool                        speech_seen;
+    bool                        head_pad_done;
+
+    std::int64_t                input_position;
+    std::int64_t                output_position;
+    std::vector<audio_kept_segment> kept_segments;
+
+    audio_sink_obj              &sink;
+    const audio_simd_kernels    &kernels;
+
+    std::error_code process_frame(const uint8_t *data, int nb_samples);
+    double measure_level(int nb_samples);
+    void apply_gain(int nb_samples, double frame_level_ms);
+    double frame_energy(size_t nb_values);
+    std::error_code emit(const uint8_t *data, int nb_samples, std::int64_t position);
+    std::error_code emit_silence_head(size_t nb_frames);
+    void drop_silence_head(size_t nb_frames);
+};
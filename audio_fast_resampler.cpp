@@ -0,0 +1,394 @@
+#include "audio_fast_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AUDIO_SIMD_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define AUDIO_SIMD_NEON 1
+#endif
+
+// kernels
+
+namespace {
+
+void downmix_stereo_scalar(const float *left, const float *right, float *out, int nb_samples) {
+    for (int i = 0; i < nb_samples; ++i) {
+        out[i] = (left[i] + right[i]) * 0.5f;
+    }
+}
+
+float dot_scalar(const float *a, const float *b, int nb_samples) {
+    float sum = 0.0f;
+    for (int i = 0; i < nb_samples; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+int16_t float_to_s16_sample(float value) {
+    auto scaled = std::clamp(value * 32768.0f, -32768.0f, 32767.0f);
+    return static_cast<int16_t>(std::lrint(scaled));
+}
+
+void float_to_s16_scalar(const float *in, int16_t *out, int nb_samples) {
+    for (int i = 0; i < nb_samples; ++i) {
+        out[i] = float_to_s16_sample(in[i]);
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+__attribute__((target("avx2,fma")))
+void downmix_stereo_avx2(const float *left, const float *right, float *out, int nb_samples) {
+    auto half = _mm256_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 8 <= nb_samples; i += 8) {
+        auto sum = _mm256_add_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(sum, half));
+    }
+    downmix_stereo_scalar(left + i, right + i, out + i, nb_samples - i);
+}
+
+__attribute__((target("avx2,fma")))
+float dot_avx2(const float *a, const float *b, int nb_samples) {
+    auto acc0 = _mm256_setzero_ps();
+    auto acc1 = _mm256_setzero_ps();
+    for (int i = 0; i < nb_samples; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    auto acc = _mm256_add_ps(acc0, acc1);
+    auto sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+void float_to_s16_avx2(const float *in, int16_t *out, int nb_samples) {
+    auto scale = _mm256_set1_ps(32768.0f);
+    auto low = _mm256_set1_ps(-32768.0f);
+    auto high = _mm256_set1_ps(32767.0f);
+    int i = 0;
+    for (; i + 16 <= nb_samples; i += 16) {
+        // clamped before the conversion, out of range floats convert to INT_MIN
+        auto first = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale), low), high);
+        auto second = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale), low), high);
+        auto packed = _mm256_packs_epi32(_mm256_cvtps_epi32(first), _mm256_cvtps_epi32(second));
+        // packs works per 128-bit lane
+        packed = _mm256_permute4x64_epi64(packed, 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), packed);
+    }
+    float_to_s16_scalar(in + i, out + i, nb_samples - i);
+}
+
+__attribute__((target("avx512f")))
+void downmix_stereo_avx512(const float *left, const float *right, float *out, int nb_samples) {
+    auto half = _mm512_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 16 <= nb_samples; i += 16) {
+        auto sum = _mm512_add_ps(_mm512_loadu_ps(left + i), _mm512_loadu_ps(right + i));
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(sum, half));
+    }
+    downmix_stereo_scalar(left + i, right + i, out + i, nb_samples - i);
+}
+
+__attribute__((target("avx512f")))
+float dot_avx512(const float *a, const float *b, int nb_samples) {
+    auto acc = _mm512_setzero_ps();
+    for (int i = 0; i < nb_samples; i += 16) {
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f")))
+void float_to_s16_avx512(const float *in, int16_t *out, int nb_samples) {
+    auto scale = _mm512_set1_ps(32768.0f);
+    auto low = _mm512_set1_ps(-32768.0f);
+    auto high = _mm512_set1_ps(32767.0f);
+    int i = 0;
+    for (; i + 16 <= nb_samples; i += 16) {
+        auto value = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(in + i), scale), low), high);
+        auto narrowed = _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(value));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), narrowed);
+    }
+    float_to_s16_scalar(in + i, out + i, nb_samples - i);
+}
+
+#endif
+
+#ifdef AUDIO_SIMD_NEON
+
+void downmix_stereo_neon(const float *left, const float *right, float *out, int nb_samples) {
+    int i = 0;
+    for (; i + 4 <= nb_samples; i += 4) {
+        vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(vld1q_f32(left + i), vld1q_f32(right + i)), 0.5f));
+    }
+    downmix_stereo_scalar(left + i, right + i, out + i, nb_samples - i);
+}
+
+float dot_neon(const float *a, const float *b, int nb_samples) {
+    auto acc0 = vdupq_n_f32(0.0f);
+    auto acc1 = vdupq_n_f32(0.0f);
+    for (int i = 0; i < nb_samples; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+}
+
+void float_to_s16_neon(const float *in, int16_t *out, int nb_samples) {
+    int i = 0;
+    for (; i + 8 <= nb_samples; i += 8) {
+        // vqmovn saturates, the float to int conversion rounds to nearest even like lrint
+        auto first = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i), 32768.0f));
+        auto second = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i + 4), 32768.0f));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(first), vqmovn_s32(second)));
+    }
+    float_to_s16_scalar(in + i, out + i, nb_samples - i);
+}
+
+#endif
+
+const audio_simd_kernels scalar_kernels = {"scalar", downmix_stereo_scalar, dot_scalar, float_to_s16_scalar};
+#ifdef AUDIO_SIMD_X86
+const audio_simd_kernels avx2_kernels = {"avx2", downmix_stereo_avx2, dot_avx2, float_to_s16_avx2};
+const audio_simd_kernels avx512_kernels = {"avx512", downmix_stereo_avx512, dot_avx512, float_to_s16_avx512};
+#endif
+#ifdef AUDIO_SIMD_NEON
+const audio_simd_kernels neon_kernels = {"neon", downmix_stereo_neon, dot_neon, float_to_s16_neon};
+#endif
+
+// filter design, same defaults as swr: 32 taps at the lower rate, cutoff 0.97, Kaiser beta 9
+
+constexpr int base_filter_size = 32;
+constexpr double filter_cutoff = 0.97;
+constexpr double kaiser_beta = 9.0;
+// keeps the coefficient table small, 44.1k -> 16k is 160 / 441
+constexpr int max_up_factor = 512;
+constexpr int max_down_factor = 1024;
+
+double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break ;
+        }
+    }
+    return sum;
+}
+
+}
+
+const audio_simd_kernels &get_audio_simd_kernels() {
+    static const audio_simd_kernels &kernels = *get_supported_audio_simd_kernels().back();
+    return kernels;
+}
+
+std::vector<const audio_simd_kernels *> get_supported_audio_simd_kernels() {
+    // ordered from the slowest to the fastest
+    std::vector<const audio_simd_kernels *> supported = {&scalar_kernels};
+#ifdef AUDIO_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        supported.push_back(&avx2_kernels);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        supported.push_back(&avx512_kernels);
+    }
+#endif
+#ifdef AUDIO_SIMD_NEON
+    supported.push_back(&neon_kernels);
+#endif
+    return supported;
+}
+
+// audio fast resampler class
+
+// public methods
+
+std::unique_ptr<audio_fast_resampler_obj> audio_fast_resampler_obj::create_audio_fast_resampler_obj(int64_t input_ch_layout,
+                                                                                                   int input_rate,
+                                                                                                   AVSampleFormat input_sample_fmt,
+                                                                                                   int64_t output_ch_layout,
+                                                                                                   int output_rate,
+                                                                                                   AVSampleFormat output_sample_fmt,
+                                                                                                   const audio_simd_kernels &simd_kernels) {
+    if (output_sample_fmt != AV_SAMPLE_FMT_S16 || output_ch_layout != AV_CH_LAYOUT_MONO) {
+        return nullptr;
+    }
+    if (input_rate <= 0 || output_rate <= 0) {
+        return nullptr;
+    }
+
+    int nb_input_channels = 0;
+    if (input_ch_layout == AV_CH_LAYOUT_MONO) {
+        nb_input_channels = 1;
+    } else if (input_ch_layout == AV_CH_LAYOUT_STEREO) {
+        nb_input_channels = 2;
+    } else {
+        return nullptr;
+    }
+
+    // planar float mono / stereo, s16 mono
+    auto float_input = input_sample_fmt == AV_SAMPLE_FMT_FLTP ||
+                       (input_sample_fmt == AV_SAMPLE_FMT_FLT && nb_input_channels == 1);
+    auto s16_input = (input_sample_fmt == AV_SAMPLE_FMT_S16 || input_sample_fmt == AV_SAMPLE_FMT_S16P) &&
+                     nb_input_channels == 1;
+    if (!float_input && !s16_input) {
+        return nullptr;
+    }
+
+    auto divisor = std::gcd(input_rate, output_rate);
+    auto interpolation = output_rate / divisor;
+    auto decimation = input_rate / divisor;
+    if (interpolation > max_up_factor || decimation > max_down_factor) {
+        return nullptr;
+    }
+
+    return std::make_unique<audio_fast_resampler_obj>(nb_input_channels,
+                                                      input_sample_fmt,
+                                                      interpolation,
+                                                      decimation,
+                                                      simd_kernels);
+}
+
+audio_fast_resampler_obj::audio_fast_resampler_obj(int nb_input_channels,
+                                                   AVSampleFormat input_sample_fmt,
+                                                   int interpolation,
+                                                   int decimation,
+                                                   const audio_simd_kernels &simd_kernels) :
+        in_channels(nb_input_channels),
+        in_format(input_sample_fmt),
+        up_factor(interpolation),
+        down_factor(decimation),
+        taps(1),
+        position(0),
+        phase(0),
+        kernels(simd_kernels) {
+
+    design_filter();
+    reset();
+}
+
+int audio_fast_resampler_obj::get_max_output_samples(int nb_samples) const {
+    auto pending = static_cast<int64_t>(history.size()) + nb_samples - static_cast<int64_t>(position);
+    return static_cast<int>(std::max<int64_t>(pending, 0) * up_factor / down_factor + 1);
+}
+
+int audio_fast_resampler_obj::convert(const uint8_t * const *in_data, int nb_samples, int16_t *out, int max_out_samples) {
+    // mono float input is appended to the history
+    auto old_size = history.size();
+    history.resize(old_size + static_cast<size_t>(nb_samples));
+    auto *mono = history.data() + old_size;
+    if (in_format == AV_SAMPLE_FMT_S16 || in_format == AV_SAMPLE_FMT_S16P) {
+        auto *samples = reinterpret_cast<const int16_t *>(in_data[0]);
+        for (int i = 0; i < nb_samples; ++i) {
+            mono[i] = static_cast<float>(samples[i]) * (1.0f / 32768.0f);
+        }
+    } else if (in_channels == 2) {
+        kernels.downmix_stereo(reinterpret_cast<const float *>(in_data[0]),
+                               reinterpret_cast<const float *>(in_data[1]),
+                               mono,
+                               nb_samples);
+    } else if (nb_samples > 0) {
+        memcpy(mono, in_data[0], static_cast<size_t>(nb_samples) * sizeof(float));
+    }
+
+    return produce(out, max_out_samples);
+}
+
+int audio_fast_resampler_obj::flush(int16_t *out, int max_out_samples) {
+    // the filter is centered, the last input sample needs taps / 2 samples of look-ahead
+    history.resize(history.size() + static_cast<size_t>(taps / 2), 0.0f);
+    return produce(out, max_out_samples);
+}
+
+int audio_fast_resampler_obj::get_max_flush_samples() const {
+    return get_max_output_samples(taps / 2);
+}
+
+void audio_fast_resampler_obj::reset() {
+    // the filter is centered on the output position, its second half is the look-ahead
+    history.assign(static_cast<size_t>(taps - 1), 0.0f);
+    position = static_cast<size_t>(taps - 1 + taps / 2);
+    phase = 0;
+}
+
+// private methods
+
+int audio_fast_resampler_obj::produce(int16_t *out, int max_out_samples) {
+    // polyphase: output n sits at n * M / L input samples, phase selects the
+    // coefficient set and only the outputs that are kept get computed
+    if (scratch.size() < static_cast<size_t>(max_out_samples)) {
+        scratch.resize(static_cast<size_t>(max_out_samples));
+    }
+    int nb_out = 0;
+    while (position < history.size() && nb_out < max_out_samples) {
+        if (taps == 1) {
+            scratch[static_cast<size_t>(nb_out)] = history[position];
+        } else {
+            scratch[static_cast<size_t>(nb_out)] = kernels.dot(coefs.data() + static_cast<size_t>(phase) * static_cast<size_t>(taps),
+                                                                history.data() + position + 1 - static_cast<size_t>(taps),
+                                                                taps);
+        }
+        ++nb_out;
+        phase += down_factor;
+        position += static_cast<size_t>(phase / up_factor);
+        phase %= up_factor;
+    }
+    kernels.float_to_s16(scratch.data(), out, nb_out);
+
+    // keep taps - 1 samples of history before the next output
+    auto consumed = std::min(position + 1 - static_cast<size_t>(taps), history.size());
+    history.erase(history.begin(), history.begin() + static_cast<std::ptrdiff_t>(consumed));
+    position -= consumed;
+
+    return nb_out;
+}
+
+
+void audio_fast_resampler_obj::design_filter() {
+    if (up_factor == 1 && down_factor == 1) {
+        taps = 1;
+        coefs.assign(1, 1.0f);
+        return;
+    }
+
+    // windowed sinc in input sample units, long enough for the lower of the two rates
+    auto factor = std::min(static_cast<double>(up_factor) / down_factor, 1.0) * filter_cutoff;
+    taps = static_cast<int>(std::ceil(base_filter_size / factor));
+    taps = (taps + 15) / 16 * 16;
+
+    auto length = up_factor * taps;
+    auto center = static_cast<double>(length / 2);
+    auto window_norm = bessel_i0(kaiser_beta);
+    std::vector<double> filter(static_cast<size_t>(length));
+    for (int m = 0; m < length; ++m) {
+        auto x = (m - center) / up_factor;
+        auto sinc_arg = M_PI * factor * x;
+        auto sinc = x == 0.0 ? 1.0 : std::sin(sinc_arg) / sinc_arg;
+        auto w = (m - center) / center;
+        auto window = bessel_i0(kaiser_beta * std::sqrt(std::max(1.0 - w * w, 0.0))) / window_norm;
+        filter[static_cast<size_t>(m)] = factor * sinc * window;
+    }
+
+    // phase p holds taps p, p + L, p + 2L, ... reversed, so the dot product runs
+    // over the history in memory order
+    coefs.assign(static_cast<size_t>(length), 0.0f);
+    for (int p = 0; p < up_factor; ++p) {
+        for (int k = 0; k < taps; ++k) {
+            coefs[static_cast<size_t>(p * taps + taps - 1 - k)] = static_cast<float>(filter[static_cast<size_t>(p + k * up_factor)]);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+#include <libavutil/channel_layout.h>
+}
+
+// vector kernels of the fast path, picked once per process by cpu feature detection
+
+struct audio_simd_kernels {
+    const char  *name;
+    // out[i] = (left[i] + right[i]) / 2
+    void        (*downmix_stereo)(const float *left, const float *right, float *out, int nb_samples);
+    // nb_samples is a multiple of 16
+    float       (*dot)(const float *a, const float *b, int nb_samples);
+    // rounds to nearest and saturates like swr
+    void        (*float_to_s16)(const float *in, int16_t *out, int nb_samples);
+};
+
+const audio_simd_kernels &get_audio_simd_kernels();
+// every kernel set the cpu can run, scalar first, the one picked above last
+std::vector<const audio_simd_kernels *> get_supported_audio_simd_kernels();
+
+// specialized converter for the common "to s16 mono" pairs: planar float mono /
+// stereo or s16 mono input at any rate whose ratio reduces to small integers
+// downmix, polyphase resampling by L/M (Kaiser windowed sinc, sized like swr's
+// default filter) and the float to s16 conversion run on the vector kernels
+// the output timeline matches swr: no added delay, the filter's look-ahead is
+// held back until more input arrives
+
+class audio_fast_resampler_obj final {
+public:
+    // nullptr when the conversion is not covered, the caller falls back to swr
+    static std::unique_ptr<audio_fast_resampler_obj> create_audio_fast_resampler_obj(int64_t input_ch_layout,
+                                                                                     int input_rate,
+                                                                                     AVSampleFormat input_sample_fmt,
+                                                                                     int64_t output_ch_layout,
+                                                                                     int output_rate,
+                                                                                     AVSampleFormat output_sample_fmt,
+                                                                                     const audio_simd_kernels &simd_kernels = get_audio_simd_kernels());
+
+    // upper bound of the samples produced by a convert call with nb_samples input
+    int get_max_output_samples(int nb_samples) const;
+    // returns the number of s16 samples written to out
+    int convert(const uint8_t * const *in_data, int nb_samples, int16_t *out, int max_out_samples);
+    // end of input: feeds the look-ahead as zeros and writes the outputs up to the
+    // last input sample, at most get_max_flush_samples(), reset before further use
+    int flush(int16_t *out, int max_out_samples);
+    int get_max_flush_samples() const;
+    void reset();
+
+    explicit audio_fast_resampler_obj(int nb_input_channels,
+                                      AVSampleFormat input_sample_fmt,
+                                      int interpolation,
+                                      int decimation,
+                                      const audio_simd_kernels &simd_kernels);
+
+private:
+
+    int                         in_channels;
+    AVSampleFormat              in_format;
+    int                         up_factor;      // L
+    int                         down_factor;    // M
+    int                         taps;           // per phase, a multiple of 16
+    std::vector<float>          coefs;          // up_factor phases of taps reversed coefficients
+
+    // mono input not consumed yet, starts with taps - 1 zeros of history
+    std::vector<float>          history;
+    size_t                      position;       // newest history sample of the next output
+    int                         phase;
+    std::vector<float>          scratch;
+    const audio_simd_kernels    &kernels;
+
+    void design_filter();
+    int produce(int16_t *out, int max_out_samples);
+};
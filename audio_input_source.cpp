@@ -0,0 +1,138 @@
+#include "audio_input_source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// memory source
+
+audio_memory_source_obj::audio_memory_source_obj(std::span<const uint8_t> data, std::shared_ptr<const void> owner) :
+        source_data(data),
+        data_owner(std::move(owner)),
+        position(0) {
+
+}
+
+std::shared_ptr<audio_memory_source_obj> audio_memory_source_obj::create_mmap_source(const std::filesystem::path &file,
+                                                                                     std::uint64_t offset,
+                                                                                     std::uint64_t length) {
+    auto fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) < 0 || offset > static_cast<std::uint64_t>(file_stat.st_size)) {
+        close(fd);
+        return nullptr;
+    }
+    auto file_size = static_cast<std::uint64_t>(file_stat.st_size);
+    if (length == 0 || offset + length > file_size) {
+        length = file_size - offset;
+    }
+    if (length == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    // mmap offsets must be page aligned, the span starts inside the first page
+    auto page_size = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    auto map_offset = offset / page_size * page_size;
+    auto map_length = static_cast<size_t>(length + offset - map_offset);
+    auto *mapping = mmap(nullptr, map_length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(map_offset));
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(mapping, map_length, MADV_SEQUENTIAL);
+
+    auto owner = std::shared_ptr<const void>(mapping, [map_length](const void *ptr) {
+        munmap(const_cast<void *>(ptr), map_length);
+    });
+    auto data = std::span<const uint8_t>(static_cast<const uint8_t *>(mapping) + (offset - map_offset),
+                                         static_cast<size_t>(length));
+
+    return std::make_shared<audio_memory_source_obj>(data, std::move(owner));
+}
+
+int audio_memory_source_obj::read(uint8_t *buf, int buf_size) {
+    if (position >= source_data.size()) {
+        return AVERROR_EOF;
+    }
+    auto chunk = std::min(static_cast<size_t>(buf_size), source_data.size() - position);
+    memcpy(buf, source_data.data() + position, chunk);
+    position += chunk;
+
+    return static_cast<int>(chunk);
+}
+
+int64_t audio_memory_source_obj::seek(int64_t offset, int whence) {
+    auto size = static_cast<int64_t>(source_data.size());
+    int64_t target = 0;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return size;
+        case SEEK_SET:
+            target = offset;
+            break ;
+        case SEEK_CUR:
+            target = static_cast<int64_t>(position) + offset;
+            break ;
+        case SEEK_END:
+            target = size + offset;
+            break ;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (target < 0 || target > size) {
+        return AVERROR(EINVAL);
+    }
+    position = static_cast<size_t>(target);
+
+    return target;
+}
+
+bool audio_memory_source_obj::is_seekable() const {
+    return true;
+}
+
+std::shared_ptr<audio_input_source_obj> audio_memory_source_obj::clone() const {
+    return std::make_shared<audio_memory_source_obj>(source_data, data_owner);
+}
+
+// reader source
+
+audio_reader_source_obj::audio_reader_source_obj(read_callback reader, seek_callback seeker) :
+        on_read(std::move(reader)),
+        on_seek(std::move(seeker)) {
+
+}
+
+int audio_reader_source_obj::read(uint8_t *buf, int buf_size) {
+    auto result = on_read(buf, buf_size);
+    return result == 0 ? AVERROR_EOF : result;
+}
+
+int64_t audio_reader_source_obj::seek(int64_t offset, int whence) {
+    if (on_seek == nullptr) {
+        return AVERROR(ENOSYS);
+    }
+    return on_seek(offset, whence & ~AVSEEK_FORCE);
+}
+
+bool audio_reader_source_obj::is_seekable() const {
+    return on_seek != nullptr;
+}
+
+std::shared_ptr<audio_input_source_obj> audio_reader_source_obj::clone() const {
+    return nullptr;
+}
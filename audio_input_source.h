@@ -0,0 +1,65 @@
+#pragma once
+
+#include <span>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <filesystem>
+
+// input byte source for a custom AVIOContext
+// read / seek follow the AVIOContext callback contract: read returns the
+// number of bytes or AVERROR_EOF, seek supports SEEK_SET / SEEK_CUR / SEEK_END
+// and AVSEEK_SIZE, negative AVERROR values report failures
+
+class audio_input_source_obj {
+public:
+    virtual ~audio_input_source_obj() = default;
+
+    virtual int read(uint8_t *buf, int buf_size) = 0;
+    virtual int64_t seek(int64_t offset, int whence) = 0;
+    virtual bool is_seekable() const = 0;
+    // independent reader over the same data (e.g. for parallel segments),
+    // nullptr when the source can't be read twice
+    virtual std::shared_ptr<audio_input_source_obj> clone() const = 0;
+};
+
+// memory span, the owner keeps the data alive (mmap'd regions, blobs)
+
+class audio_memory_source_obj final : public audio_input_source_obj {
+public:
+    explicit audio_memory_source_obj(std::span<const uint8_t> data, std::shared_ptr<const void> owner = nullptr);
+
+    // maps [offset, offset + length) of a file, length 0 maps to the end of the file
+    static std::shared_ptr<audio_memory_source_obj> create_mmap_source(const std::filesystem::path &file,
+                                                                       std::uint64_t offset = 0,
+                                                                       std::uint64_t length = 0);
+
+    int read(uint8_t *buf, int buf_size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    bool is_seekable() const override;
+    std::shared_ptr<audio_input_source_obj> clone() const override;
+
+private:
+    std::span<const uint8_t>    source_data;
+    std::shared_ptr<const void> data_owner;
+    size_t                      position;
+};
+
+// pull-based reader, seek and size are optional
+
+class audio_reader_source_obj final : public audio_input_source_obj {
+public:
+    using read_callback = std::function<int(uint8_t *, int)>;
+    using seek_callback = std::function<int64_t(int64_t, int)>;
+
+    explicit audio_reader_source_obj(read_callback reader, seek_callback seeker = nullptr);
+
+    int read(uint8_t *buf, int buf_size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    bool is_seekable() const override;
+    std::shared_ptr<audio_input_source_obj> clone() const override;
+
+private:
+    read_callback   on_read;
+    seek_callback   on_seek;
+};
@@ -0,0 +1,126 @@
+#include "audio_interleave.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define AUDIO_INTERLEAVE_SSE2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define AUDIO_INTERLEAVE_NEON 1
+#endif
+
+namespace {
+
+template<typename T>
+void interleave_generic(std::span<const std::span<const uint8_t> > planes, int first, int nb_samples, uint8_t *out) {
+    auto nb_planes = planes.size();
+    auto *dst = reinterpret_cast<T *>(out);
+    for (size_t ch = 0; ch < nb_planes; ++ch) {
+        const auto *src = reinterpret_cast<const T *>(planes[ch].data());
+        for (int i = first; i < nb_samples; ++i) {
+            dst[static_cast<size_t>(i) * nb_planes + ch] = src[i];
+        }
+    }
+}
+
+// returns the number of samples done, the caller finishes the tail
+int interleave_stereo_vector(const uint8_t *left, const uint8_t *right, int nb_samples, size_t sample_size, uint8_t *out) {
+    int i = 0;
+#ifdef AUDIO_INTERLEAVE_SSE2
+    // 16 bytes of each plane per step, unpack lo / hi at the sample width
+    auto step = static_cast<int>(16 / sample_size);
+    for (; i + step <= nb_samples; i += step) {
+        auto offset = static_cast<size_t>(i) * sample_size;
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(left + offset));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(right + offset));
+        __m128i low;
+        __m128i high;
+        if (sample_size == 2) {
+            low = _mm_unpacklo_epi16(a, b);
+            high = _mm_unpackhi_epi16(a, b);
+        } else if (sample_size == 4) {
+            low = _mm_unpacklo_epi32(a, b);
+            high = _mm_unpackhi_epi32(a, b);
+        } else {
+            low = _mm_unpacklo_epi64(a, b);
+            high = _mm_unpackhi_epi64(a, b);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * offset), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * offset + 16), high);
+    }
+#elif defined(AUDIO_INTERLEAVE_NEON)
+    // vst2 stores two registers interleaved at the sample width
+    if (sample_size == 2) {
+        for (; i + 8 <= nb_samples; i += 8) {
+            uint16x8x2_t pair = {{vld1q_u16(reinterpret_cast<const uint16_t *>(left) + i),
+                                  vld1q_u16(reinterpret_cast<const uint16_t *>(right) + i)}};
+            vst2q_u16(reinterpret_cast<uint16_t *>(out) + 2 * i, pair);
+        }
+    } else if (sample_size == 4) {
+        for (; i + 4 <= nb_samples; i += 4) {
+            uint32x4x2_t pair = {{vld1q_u32(reinterpret_cast<const uint32_t *>(left) + i),
+                                  vld1q_u32(reinterpret_cast<const uint32_t *>(right) + i)}};
+            vst2q_u32(reinterpret_cast<uint32_t *>(out) + 2 * i, pair);
+        }
+    } else {
+        for (; i + 2 <= nb_samples; i += 2) {
+            uint64x2x2_t pair = {{vld1q_u64(reinterpret_cast<const uint64_t *>(left) + i),
+                                  vld1q_u64(reinterpret_cast<const uint64_t *>(right) + i)}};
+            vst2q_u64(reinterpret_cast<uint64_t *>(out) + 2 * i, pair);
+        }
+    }
+#else
+    (void)left;
+    (void)right;
+    (void)nb_samples;
+    (void)sample_size;
+    (void)out;
+#endif
+    return i;
+}
+
+}
+
+void audio_interleave_planes(std::span<const std::span<const uint8_t> > planes,
+                             int nb_samples,
+                             size_t sample_size,
+                             uint8_t *out) {
+    if (planes.empty() || nb_samples <= 0) {
+        return;
+    }
+    if (planes.size() == 1) {
+        memcpy(out, planes[0].data(), static_cast<size_t>(nb_samples) * sample_size);
+        return;
+    }
+
+    auto vector_size = sample_size == 2 || sample_size == 4 || sample_size == 8;
+    int first = 0;
+    if (planes.size() == 2 && vector_size) {
+        first = interleave_stereo_vector(planes[0].data(), planes[1].data(), nb_samples, sample_size, out);
+    }
+
+    switch (sample_size) {
+        case 1:
+            interleave_generic<uint8_t>(planes, first, nb_samples, out);
+            break ;
+        case 2:
+            interleave_generic<uint16_t>(planes, first, nb_samples, out);
+            break ;
+        case 4:
+            interleave_generic<uint32_t>(planes, first, nb_samples, out);
+            break ;
+        case 8:
+            interleave_generic<uint64_t>(planes, first, nb_samples, out);
+            break ;
+        default:
+            for (size_t ch = 0; ch < planes.size(); ++ch) {
+                for (int i = first; i < nb_samples; ++i) {
+                    memcpy(out + (static_cast<size_t>(i) * planes.size() + ch) * sample_size,
+                           planes[ch].data() + static_cast<size_t>(i) * sample_size,
+                           sample_size);
+                }
+            }
+            break ;
+    }
+}
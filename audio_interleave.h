@@ -0,0 +1,14 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+// interleaves one plane per channel into packed order, out holds
+// planes.size() * nb_samples * sample_size bytes
+// 2 / 4 / 8 byte samples of stereo output take the vector path (SSE2 / NEON)
+
+void audio_interleave_planes(std::span<const std::span<const uint8_t> > planes,
+                             int nb_samples,
+                             size_t sample_size,
+                             uint8_t *out);
@@ -0,0 +1,278 @@
+#include "audio_memory_arena.h"
+
+#include <algorithm>
+#include <cerrno>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+namespace {
+
+// opaque of a frame pool and of its buffers, keeps the arena alive until the
+// pool is freed, which happens after its last buffer came back
+struct audio_frame_pool_owner {
+    std::shared_ptr<audio_memory_arena_obj> arena;
+    std::size_t                             size;
+};
+
+// only decoders with AV_CODEC_CAP_DR1 accept frame buffers from a custom get_buffer2
+bool supports_custom_buffers(const AVCodecContext *decoder_ctx) {
+    return decoder_ctx->codec != nullptr && (decoder_ctx->codec->capabilities & AV_CODEC_CAP_DR1) != 0;
+}
+
+}
+
+// audio memory budget class
+
+audio_memory_budget_obj::audio_memory_budget_obj(std::size_t limit_bytes) :
+        limit(limit_bytes),
+        reserved(0) {
+
+}
+
+bool audio_memory_budget_obj::acquire(std::size_t bytes, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(guard);
+    if (bytes > limit) {
+        return false;
+    }
+    if (!released.wait_for(lock, timeout, [&]() { return reserved + bytes <= limit; })) {
+        return false;
+    }
+    reserved += bytes;
+
+    return true;
+}
+
+void audio_memory_budget_obj::release(std::size_t bytes) {
+    {
+        std::lock_guard lock(guard);
+        reserved -= std::min(bytes, reserved);
+    }
+    released.notify_all();
+}
+
+std::size_t audio_memory_budget_obj::get_limit() const {
+    return limit;
+}
+
+std::size_t audio_memory_budget_obj::get_reserved() const {
+    std::lock_guard lock(guard);
+    return reserved;
+}
+
+// audio memory arena class
+
+// public methods
+
+std::shared_ptr<audio_memory_arena_obj> audio_memory_arena_obj::create_audio_memory_arena_obj(std::size_t limit_bytes,
+                                                                                             std::shared_ptr<audio_memory_budget_obj> budget,
+                                                                                             std::chrono::milliseconds admission_timeout) {
+    if (budget != nullptr && !budget->acquire(limit_bytes, admission_timeout)) {
+        return nullptr;
+    }
+
+    return std::make_shared<audio_memory_arena_obj>(limit_bytes, std::move(budget));
+}
+
+audio_memory_arena_obj::audio_memory_arena_obj(std::size_t limit_bytes, std::shared_ptr<audio_memory_budget_obj> budget) :
+        limit(limit_bytes),
+        global_budget(std::move(budget)),
+        used(0),
+        peak(0),
+        exceeded(false),
+        resource(*this, &buffer_pool),
+        frame_pool(nullptr),
+        frame_pool_size(0) {
+
+}
+
+audio_memory_arena_obj::~audio_memory_arena_obj() {
+    // a live frame pool holds a reference, so it is gone by now
+    if (global_budget != nullptr) {
+        global_budget->release(limit);
+    }
+}
+
+bool audio_memory_arena_obj::charge(std::size_t bytes) {
+    auto current = used.load();
+    do {
+        if (current + bytes > limit) {
+            return false;
+        }
+    } while (!used.compare_exchange_weak(current, current + bytes));
+    update_peak(current + bytes);
+
+    return true;
+}
+
+void audio_memory_arena_obj::force_charge(std::size_t bytes) {
+    auto current = used.fetch_add(bytes) + bytes;
+    if (current > limit) {
+        exceeded = true;
+    }
+    update_peak(current);
+}
+
+void audio_memory_arena_obj::discharge(std::size_t bytes) {
+    used -= bytes;
+}
+
+std::size_t audio_memory_arena_obj::get_limit() const {
+    return limit;
+}
+
+std::size_t audio_memory_arena_obj::get_used() const {
+    return used.load();
+}
+
+std::size_t audio_memory_arena_obj::get_peak() const {
+    return peak.load();
+}
+
+bool audio_memory_arena_obj::is_exceeded() const {
+    return exceeded.load();
+}
+
+std::pmr::memory_resource *audio_memory_arena_obj::get_resource() {
+    return &resource;
+}
+
+void audio_memory_arena_obj::attach_decoder(AVCodecContext *decoder_ctx) {
+    if (!supports_custom_buffers(decoder_ctx)) {
+        return ;
+    }
+    decoder_ctx->opaque = this;
+    decoder_ctx->get_buffer2 = get_buffer2;
+}
+
+void audio_memory_arena_obj::detach_decoder(AVCodecContext *decoder_ctx) {
+    if (decoder_ctx->get_buffer2 == get_buffer2) {
+        decoder_ctx->get_buffer2 = avcodec_default_get_buffer2;
+        decoder_ctx->opaque = nullptr;
+    }
+}
+
+void audio_memory_arena_obj::close() {
+    std::lock_guard lock(frame_pool_guard);
+    av_buffer_pool_uninit(&frame_pool);
+    frame_pool_size = 0;
+}
+
+// private methods
+
+audio_memory_arena_obj::counting_resource::counting_resource(audio_memory_arena_obj &owner,
+                                                             std::pmr::memory_resource *upstream) :
+        arena(owner),
+        upstream_resource(upstream) {
+
+}
+
+void *audio_memory_arena_obj::counting_resource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    // std::pmr has no failure value other than throwing, the overrun is
+    // reported through is_exceeded instead
+    arena.force_charge(bytes);
+    return upstream_resource->allocate(bytes, alignment);
+}
+
+void audio_memory_arena_obj::counting_resource::do_deallocate(void *p, std::size_t bytes, std::size_t alignment) {
+    upstream_resource->deallocate(p, bytes, alignment);
+    arena.discharge(bytes);
+}
+
+bool audio_memory_arena_obj::counting_resource::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+int audio_memory_arena_obj::get_buffer2(AVCodecContext *decoder_ctx, AVFrame *frame, int flags) {
+    auto *arena = static_cast<audio_memory_arena_obj *>(decoder_ctx->opaque);
+    if (arena == nullptr || !supports_custom_buffers(decoder_ctx)) {
+        return avcodec_default_get_buffer2(decoder_ctx, frame, flags);
+    }
+    auto result = arena->get_frame_buffer(frame);
+    // layouts with more planes than data pointers stay with the default allocator
+    if (result > 0) {
+        return avcodec_default_get_buffer2(decoder_ctx, frame, flags);
+    }
+
+    return result;
+}
+
+AVBufferRef *audio_memory_arena_obj::alloc_frame_buffer(void *opaque, std::size_t size) {
+    auto *owner = static_cast<audio_frame_pool_owner *>(opaque);
+    if (!owner->arena->charge(size)) {
+        owner->arena->exceeded = true;
+        return nullptr;
+    }
+
+    auto *data = static_cast<uint8_t *>(av_malloc(size));
+    if (data == nullptr) {
+        owner->arena->discharge(size);
+        return nullptr;
+    }
+    auto *buffer = av_buffer_create(data, size, free_frame_buffer, owner, 0);
+    if (buffer == nullptr) {
+        av_free(data);
+        owner->arena->discharge(size);
+    }
+
+    return buffer;
+}
+
+void audio_memory_arena_obj::free_frame_buffer(void *opaque, uint8_t *data) {
+    auto *owner = static_cast<audio_frame_pool_owner *>(opaque);
+    av_free(data);
+    owner->arena->discharge(owner->size);
+}
+
+void audio_memory_arena_obj::free_frame_pool(void *opaque) {
+    delete static_cast<audio_frame_pool_owner *>(opaque);
+}
+
+int audio_memory_arena_obj::get_frame_buffer(AVFrame *frame) {
+    auto format = static_cast<AVSampleFormat>(frame->format);
+    auto nb_planes = av_sample_fmt_is_planar(format) ? frame->channels : 1;
+    if (nb_planes > AV_NUM_DATA_POINTERS) {
+        return 1;
+    }
+
+    int linesize = 0;
+    if (av_samples_get_buffer_size(&linesize, frame->channels, frame->nb_samples, format, 0) < 0) {
+        return AVERROR(EINVAL);
+    }
+    auto plane_size = static_cast<std::size_t>(linesize) + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    std::lock_guard lock(frame_pool_guard);
+    // buffers of the previous pool return to it and are freed with it
+    if (frame_pool == nullptr || plane_size > frame_pool_size) {
+        av_buffer_pool_uninit(&frame_pool);
+        auto *owner = new audio_frame_pool_owner{shared_from_this(), plane_size};
+        frame_pool = av_buffer_pool_init2(plane_size, owner, alloc_frame_buffer, free_frame_pool);
+        if (frame_pool == nullptr) {
+            delete owner;
+            return AVERROR(ENOMEM);
+        }
+        frame_pool_size = plane_size;
+    }
+
+    for (int i = 0; i < nb_planes; ++i) {
+        frame->buf[i] = av_buffer_pool_get(frame_pool);
+        if (frame->buf[i] == nullptr) {
+            for (int k = 0; k < i; ++k) {
+                av_buffer_unref(&frame->buf[k]);
+            }
+            return AVERROR(ENOMEM);
+        }
+        frame->data[i] = frame->buf[i]->data;
+    }
+    frame->extended_data = frame->data;
+    frame->linesize[0] = linesize;
+
+    return 0;
+}
+
+void audio_memory_arena_obj::update_peak(std::size_t value) {
+    auto current = peak.load();
+    while (value > current && !peak.compare_exchange_weak(current, value)) {
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <cstdint>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// process-wide memory budget, every conversion reserves its hard limit from it
+// before it starts and returns the reservation when its memory is released,
+// so conversions are only admitted while the node has room for their worst case
+
+class audio_memory_budget_obj final {
+public:
+    explicit audio_memory_budget_obj(std::size_t limit_bytes);
+    // Disallow copying
+    audio_memory_budget_obj(audio_memory_budget_obj &other) = delete;
+    audio_memory_budget_obj &operator=(audio_memory_budget_obj &other) = delete;
+
+    // waits up to timeout for room, false when it did not free up in time or
+    // the request exceeds the whole budget; a zero timeout only tries once,
+    // which is what callers on an event loop should use
+    bool acquire(std::size_t bytes, std::chrono::milliseconds timeout);
+    void release(std::size_t bytes);
+
+    std::size_t get_limit() const;
+    std::size_t get_reserved() const;
+
+private:
+    std::size_t                 limit;
+    std::size_t                 reserved;
+    mutable std::mutex          guard;
+    std::condition_variable     released;
+};
+
+struct audio_memory_options {
+    std::size_t     conversion_limit_bytes = 0;     // 0 disables the arena
+    // optional admission control shared between demuxers
+    std::shared_ptr<audio_memory_budget_obj> budget;
+    std::chrono::milliseconds admission_timeout {0};
+};
+
+// per-conversion memory with a hard limit
+// decoder frames come from the arena's AVBufferPool through a get_buffer2 hook
+// and fail with ENOMEM past the limit, our own buffers (stages, chunker) come
+// from get_resource(), a pool resource that marks the arena exceeded instead of
+// failing, the demuxer ends the conversion at the next packet then
+// the arena lives until the last frame buffer it handed out is released
+
+class audio_memory_arena_obj final : public std::enable_shared_from_this<audio_memory_arena_obj> {
+public:
+    // nullptr when the budget did not admit limit_bytes in time
+    static std::shared_ptr<audio_memory_arena_obj> create_audio_memory_arena_obj(std::size_t limit_bytes,
+                                                                                 std::shared_ptr<audio_memory_budget_obj> budget,
+                                                                                 std::chrono::milliseconds admission_timeout);
+    ~audio_memory_arena_obj();
+    // Disallow copying
+    audio_memory_arena_obj(audio_memory_arena_obj &other) = delete;
+    audio_memory_arena_obj &operator=(audio_memory_arena_obj &other) = delete;
+
+    // false, with nothing charged, when the bytes do not fit into the limit
+    bool charge(std::size_t bytes);
+    // charges past the limit and marks the arena exceeded
+    void force_charge(std::size_t bytes);
+    void discharge(std::size_t bytes);
+
+    std::size_t get_limit() const;
+    std::size_t get_used() const;
+    std::size_t get_peak() const;
+    bool is_exceeded() const;
+
+    std::pmr::memory_resource *get_resource();
+
+    // decoded frames of the context are allocated from the arena until detach,
+    // decoders without AV_CODEC_CAP_DR1 keep the default allocator
+    void attach_decoder(AVCodecContext *decoder_ctx);
+    void detach_decoder(AVCodecContext *decoder_ctx);
+    // drops the frame pool, buffers still in use return to the arena when released
+    void close();
+
+    audio_memory_arena_obj(std::size_t limit_bytes, std::shared_ptr<audio_memory_budget_obj> budget);
+
+private:
+
+    // counts the bytes of our own buffers, upstream is the arena's pool resource
+    class counting_resource final : public std::pmr::memory_resource {
+    public:
+        counting_resource(audio_memory_arena_obj &owner, std::pmr::memory_resource *upstream);
+
+    private:
+        audio_memory_arena_obj      &arena;
+        std::pmr::memory_resource   *upstream_resource;
+
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+    };
+
+    std::size_t                 limit;
+    std::shared_ptr<audio_memory_budget_obj> global_budget;
+    std::atomic<std::size_t>    used;
+    std::atomic<std::size_t>    peak;
+    std::atomic<bool>           exceeded;
+
+    std::pmr::unsynchronized_pool_resource buffer_pool;
+    counting_resource           resource;
+
+    // plane buffers of decoded frames, recreated when a frame needs larger planes
+    std::mutex                  frame_pool_guard;
+    AVBufferPool                *frame_pool;
+    std::size_t                 frame_pool_size;
+
+    static int get_buffer2(AVCodecContext *decoder_ctx, AVFrame *frame, int flags);
+    static AVBufferRef *alloc_frame_buffer(void *opaque, std::size_t size);
+    static void free_frame_buffer(void *opaque, uint8_t *data);
+    static void free_frame_pool(void *opaque);
+    int get_frame_buffer(AVFrame *frame);
+    void update_peak(std::size_t value);
+};
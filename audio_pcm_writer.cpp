@@ -0,0 +1,358 @@
+#include "audio_pcm_writer.h"
+#include "audio_demuxer.h"
+#include "audio_interleave.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// public methods
+
+std::unique_ptr<audio_pcm_writer_obj> audio_pcm_writer_obj::create_audio_pcm_writer_obj(const std::filesystem::path &output_file,
+                                                                                        const audio_pcm_writer_options &options) {
+    // the per-channel files are opened once the channel count is known
+    if (options.layout == audio_output_layout::separate_files) {
+        auto writer = std::unique_ptr<audio_pcm_writer_obj>(new audio_pcm_writer_obj(-1, options));
+        writer->output_path = output_file;
+        return writer;
+    }
+
+    auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (options.direct_io) {
+        flags |= O_DIRECT;
+    }
+
+    auto output_fd = open(output_file.c_str(), flags, 0644);
+    if (output_fd < 0) {
+        return nullptr;
+    }
+
+    auto writer = std::unique_ptr<audio_pcm_writer_obj>(new audio_pcm_writer_obj(output_fd, options));
+    if (!writer->alloc_blocks()) {
+        return nullptr;
+    }
+    writer->writer_thread = std::thread(&audio_pcm_writer_obj::writer_loop, writer.get());
+
+    return writer;
+}
+
+std::unique_ptr<audio_pcm_writer_obj> audio_pcm_writer_obj::create_audio_pcm_writer_obj(int output_fd,
+                                                                                        std::uint64_t start_offset,
+                                                                                        const audio_pcm_writer_options &options) {
+    // O_DIRECT offsets and the planar block headers depend on what was written before
+    if (output_fd < 0 || options.direct_io || options.layout != audio_output_layout::interleaved) {
+        return nullptr;
+    }
+
+    auto writer = std::unique_ptr<audio_pcm_writer_obj>(new audio_pcm_writer_obj(output_fd, options, false, start_offset));
+    if (!writer->alloc_blocks()) {
+        return nullptr;
+    }
+    writer->writer_thread = std::thread(&audio_pcm_writer_obj::writer_loop, writer.get());
+
+    return writer;
+}
+
+audio_pcm_writer_obj::~audio_pcm_writer_obj() {
+    finish();
+    if (fd >= 0 && owns_fd) {
+        ::close(fd);
+    }
+}
+
+std::error_code audio_pcm_writer_obj::consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    if (opts.layout == audio_output_layout::separate_files) {
+        return consume_separate(planes, nb_samples);
+    }
+    if (current_block == nullptr || finished) {
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+
+    if (planes.size() > 1 && nb_samples > 0) {
+        auto sample_size = planes[0].size() / static_cast<size_t>(nb_samples);
+        if (opts.layout == audio_output_layout::interleaved) {
+            return append_interleaved(planes, nb_samples, sample_size);
+        }
+
+        audio_block_planar_header header;
+        header.nb_channels = static_cast<std::uint32_t>(planes.size());
+        header.nb_samples = static_cast<std::uint32_t>(nb_samples);
+        header.sample_size = static_cast<std::uint32_t>(sample_size);
+        auto result = append_bytes(std::span(reinterpret_cast<const uint8_t *>(&header), sizeof(header)));
+        if (result) {
+            return result;
+        }
+    }
+
+    for (auto item : planes) {
+        auto result = append_bytes(item);
+        if (result) {
+            return result;
+        }
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_pcm_writer_obj::finish() {
+    if (finished) {
+        return write_failed ? audio_demuxer_errc::WRITE_OUTPUT_ERR : audio_demuxer_errc::SUCCESS;
+    }
+    finished = true;
+
+    if (opts.layout == audio_output_layout::separate_files) {
+        for (auto & item : channel_writers) {
+            if (item->finish()) {
+                write_failed = true;
+            }
+        }
+        return write_failed ? audio_demuxer_errc::WRITE_OUTPUT_ERR : audio_demuxer_errc::SUCCESS;
+    }
+
+    // a failed write took the current block away, the writer thread is only stopped
+    bool failed = false;
+    {
+        std::lock_guard lock(guard);
+        failed = write_failed || current_block == nullptr;
+    }
+
+    // O_DIRECT needs aligned lengths, the tail is padded and truncated afterwards
+    auto total_size = file_offset + current_size;
+    auto result = std::error_code(audio_demuxer_errc::SUCCESS);
+    if (!failed && current_size > 0 && opts.direct_io) {
+        auto padded_size = (current_size + opts.alignment - 1) / opts.alignment * opts.alignment;
+        memset(current_block + current_size, 0, padded_size - current_size);
+        current_size = padded_size;
+    }
+    if (!failed && current_size > 0) {
+        result = submit_current_block();
+    }
+
+    {
+        std::lock_guard lock(guard);
+        stop_requested = true;
+    }
+    full_cv.notify_one();
+    if (writer_thread.joinable()) {
+        writer_thread.join();
+    }
+
+    if (!write_failed && opts.direct_io && ftruncate(fd, static_cast<off_t>(total_size)) < 0) {
+        write_failed = true;
+    }
+    file_offset = total_size;
+    if (write_failed) {
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+
+    return result;
+}
+
+std::uint64_t audio_pcm_writer_obj::get_bytes_written() const {
+    auto bytes = file_offset - start_offset;
+    for (auto & item : channel_writers) {
+        bytes += item->get_bytes_written();
+    }
+    return bytes;
+}
+
+// private methods
+
+void audio_pcm_writer_obj::block_deleter::operator()(uint8_t *ptr) const {
+    std::free(ptr);
+}
+
+audio_pcm_writer_obj::audio_pcm_writer_obj(int output_fd,
+                                           const audio_pcm_writer_options &options,
+                                           bool owns_output,
+                                           std::uint64_t output_offset) :
+        opts(options),
+        fd(output_fd),
+        owns_fd(owns_output),
+        start_offset(output_offset),
+        finished(false),
+        current_block(nullptr),
+        current_size(0),
+        file_offset(output_offset),
+        stop_requested(false),
+        write_failed(false) {
+
+    opts.alignment = std::max<size_t>(opts.alignment, 1);
+    opts.block_size = std::max(opts.block_size, opts.alignment);
+    opts.block_size = (opts.block_size + opts.alignment - 1) / opts.alignment * opts.alignment;
+    opts.nb_blocks = std::max<size_t>(opts.nb_blocks, 2);
+}
+
+bool audio_pcm_writer_obj::alloc_blocks() {
+    for (size_t i = 0; i < opts.nb_blocks; ++i) {
+        auto *data = static_cast<uint8_t *>(std::aligned_alloc(opts.alignment, opts.block_size));
+        if (data == nullptr) {
+            return false;
+        }
+        blocks.emplace_back(data);
+        free_blocks.push_back(data);
+    }
+
+    current_block = free_blocks.front();
+    free_blocks.pop_front();
+
+    return true;
+}
+
+std::error_code audio_pcm_writer_obj::append_bytes(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        auto chunk = std::min(data.size(), opts.block_size - current_size);
+        memcpy(current_block + current_size, data.data(), chunk);
+        current_size += chunk;
+        data = data.subspan(chunk);
+
+        if (current_size == opts.block_size) {
+            auto result = submit_current_block();
+            if (result) {
+                return result;
+            }
+        }
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_pcm_writer_obj::append_interleaved(std::span<const std::span<const uint8_t> > planes,
+                                                         int nb_samples,
+                                                         size_t sample_size) {
+    auto frame_size = sample_size * planes.size();
+    offset_planes.resize(planes.size());
+
+    // whole frames are interleaved in place, one pass over the planes
+    int done = 0;
+    while (done < nb_samples) {
+        for (size_t i = 0; i < planes.size(); ++i) {
+            offset_planes[i] = planes[i].subspan(static_cast<size_t>(done) * sample_size);
+        }
+
+        auto fit = std::min<size_t>((opts.block_size - current_size) / frame_size, static_cast<size_t>(nb_samples - done));
+        if (fit == 0) {
+            // a frame straddles two blocks
+            straddle_frame.resize(frame_size);
+            audio_interleave_planes(offset_planes, 1, sample_size, straddle_frame.data());
+            auto result = append_bytes(straddle_frame);
+            if (result) {
+                return result;
+            }
+            done += 1;
+            continue ;
+        }
+
+        audio_interleave_planes(offset_planes, static_cast<int>(fit), sample_size, current_block + current_size);
+        current_size += fit * frame_size;
+        done += static_cast<int>(fit);
+        if (current_size == opts.block_size) {
+            auto result = submit_current_block();
+            if (result) {
+                return result;
+            }
+        }
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_pcm_writer_obj::consume_separate(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    if (finished) {
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+
+    if (channel_writers.empty()) {
+        auto channel_options = opts;
+        channel_options.layout = audio_output_layout::interleaved;
+        for (size_t i = 0; i < planes.size(); ++i) {
+            auto channel_file = output_path;
+            channel_file += "." + std::to_string(i);
+            auto writer = create_audio_pcm_writer_obj(channel_file, channel_options);
+            if (writer == nullptr) {
+                return audio_demuxer_errc::OPEN_OUTPUT_FSTREAM_ERR;
+            }
+            channel_writers.push_back(std::move(writer));
+        }
+    }
+    if (channel_writers.size() != planes.size()) {
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+
+    for (size_t i = 0; i < planes.size(); ++i) {
+        auto result = channel_writers[i]->consume(planes.subspan(i, 1), nb_samples);
+        if (result) {
+            return result;
+        }
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_pcm_writer_obj::submit_current_block() {
+    std::unique_lock lock(guard);
+    if (write_failed) {
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+
+    full_blocks.push_back({current_block, current_size, static_cast<off_t>(file_offset)});
+    file_offset += current_size;
+    full_cv.notify_one();
+
+    // backpressure: wait for the writer thread to hand a block back
+    free_cv.wait(lock, [this]() { return write_failed || !free_blocks.empty(); });
+    if (write_failed) {
+        current_block = nullptr;
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+    current_block = free_blocks.front();
+    free_blocks.pop_front();
+    current_size = 0;
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+void audio_pcm_writer_obj::writer_loop() {
+    while (true) {
+        std::unique_lock lock(guard);
+        full_cv.wait(lock, [this]() { return stop_requested || !full_blocks.empty(); });
+        if (full_blocks.empty()) {
+            return;
+        }
+        auto block = full_blocks.front();
+        full_blocks.pop_front();
+        lock.unlock();
+
+        auto ok = write_block(block);
+
+        lock.lock();
+        if (!ok) {
+            write_failed = true;
+        }
+        free_blocks.push_back(block.data);
+        lock.unlock();
+        free_cv.notify_one();
+    }
+}
+
+bool audio_pcm_writer_obj::write_block(const pending_block &block) {
+    size_t done = 0;
+    while (done < block.size) {
+        auto result = pwrite(fd,
+                             block.data + done,
+                             block.size - done,
+                             block.offset + static_cast<off_t>(done));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue ;
+            }
+            return false;
+        }
+        done += static_cast<size_t>(result);
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "audio_sink.h"
+
+// file layout of planar output (one plane per channel), packed output is written as is
+
+enum class audio_output_layout {
+    interleaved,        // packed sample order, interleaved straight into the write block
+    block_planar,       // every chunk is an audio_block_planar_header followed by its planes
+    separate_files,     // channel n goes to <output_file>.<n>
+};
+
+struct audio_block_planar_header {
+    char            magic[4] = {'A', 'P', 'L', 'N'};
+    std::uint32_t   nb_channels = 0;
+    std::uint32_t   nb_samples = 0;     // per channel
+    std::uint32_t   sample_size = 0;    // bytes
+};
+
+// output writer settings
+
+struct audio_pcm_writer_options {
+    size_t  block_size = 1 << 20;   // bytes per write, rounded up to the alignment
+    size_t  nb_blocks = 4;          // blocks in flight between decode and writer threads
+    size_t  alignment = 4096;       // buffer / offset alignment, required by O_DIRECT
+    bool    direct_io = false;      // open the file with O_DIRECT (bypass page cache)
+    audio_output_layout layout = audio_output_layout::interleaved;
+};
+
+// batches converted samples into large aligned blocks and writes them with
+// pwrite on a dedicated thread, so the decode thread only copies into memory
+
+class audio_pcm_writer_obj final : public audio_sink_obj {
+public:
+    static std::unique_ptr<audio_pcm_writer_obj> create_audio_pcm_writer_obj(const std::filesystem::path &output_file,
+                                                                             const audio_pcm_writer_options &options = {});
+    // writes into an already open file from start_offset on without closing it,
+    // writers on disjoint ranges can share the file, only the interleaved layout
+    // without direct_io is available, nullptr otherwise
+    static std::unique_ptr<audio_pcm_writer_obj> create_audio_pcm_writer_obj(int output_fd,
+                                                                             std::uint64_t start_offset,
+                                                                             const audio_pcm_writer_options &options = {});
+    ~audio_pcm_writer_obj() override;
+    // Disallow copying
+    audio_pcm_writer_obj(audio_pcm_writer_obj &other) = delete;
+    audio_pcm_writer_obj &operator=(audio_pcm_writer_obj &other) = delete;
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override;
+    // writes the pending tail and waits for the writer thread
+    std::error_code finish();
+
+    std::uint64_t get_bytes_written() const;
+
+private:
+
+    struct block_deleter {
+        void operator()(uint8_t *ptr) const;
+    };
+    using block_ptr = std::unique_ptr<uint8_t[], block_deleter>;
+
+    struct pending_block {
+        uint8_t *data;
+        size_t  size;
+        off_t   offset;
+    };
+
+    audio_pcm_writer_options    opts;
+    int                         fd;
+    bool                        owns_fd;
+    std::uint64_t               start_offset;
+    bool                        finished;
+
+    // separate files: one interleaved writer per channel, opened on the first chunk
+    std::filesystem::path       output_path;
+    std::vector<std::unique_ptr<audio_pcm_writer_obj> > channel_writers;
+    std::vector<std::span<const uint8_t> > offset_planes;
+    std::vector<uint8_t>        straddle_frame;
+
+    std::vector<block_ptr>      blocks;
+    std::deque<uint8_t *>       free_blocks;
+    std::deque<pending_block>   full_blocks;
+    uint8_t                     *current_block;
+    size_t                      current_size;
+    std::uint64_t               file_offset;
+    bool                        stop_requested;
+    bool                        write_failed;
+
+    std::mutex                  guard;
+    std::condition_variable     free_cv;
+    std::condition_variable     full_cv;
+    std::thread                 writer_thread;
+
+    explicit audio_pcm_writer_obj(int output_fd,
+                                  const audio_pcm_writer_options &options,
+                                  bool owns_output = true,
+                                  std::uint64_t output_offset = 0);
+
+    bool alloc_blocks();
+    std::error_code append_bytes(std::span<const uint8_t> data);
+    std::error_code append_interleaved(std::span<const std::span<const uint8_t> > planes, int nb_samples, size_t sample_size);
+    std::error_code consume_separate(std::span<const std::span<const uint8_t> > planes, int nb_samples);
+    std::error_code submit_current_block();
+    void writer_loop();
+    bool write_block(const pending_block &block);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// opt-in pipelined mode: demux, decode and resample + output run on separate
+// threads connected by bounded spsc queues of pooled packets and frames
+
+struct audio_pipeline_options {
+    bool    enabled = false;
+    size_t  packet_queue_size = 64;     // pooled AVPacket objects between demux and decode
+    size_t  frame_queue_size = 16;      // pooled AVFrame objects between decode and resample
+};
+
+// nanoseconds each stage spent waiting on its neighbours
+
+struct audio_pipeline_stage_stats {
+    std::uint64_t   input_stall_ns = 0;     // waiting for work from the previous stage
+    std::uint64_t   output_stall_ns = 0;    // waiting for room / pooled objects downstream
+    std::uint64_t   items = 0;
+};
+
+struct audio_pipeline_stats {
+    audio_pipeline_stage_stats  demux;
+    audio_pipeline_stage_stats  decode;
+    audio_pipeline_stage_stats  output;
+};
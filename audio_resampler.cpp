@@ -1,5 +1,7 @@
 #include "audio_resampler.h"
 
+#include <algorithm>
+
 // public methods
 
 std::unique_ptr<audio_resampler_obj> audio_resampler_obj::create_audio_resampler_obj(int64_t input_ch_layout,
@@ -7,7 +9,8 @@ std::unique_ptr<audio_resampler_obj> audio_resampler_obj::create_audio_resampler
                                                                                      AVSampleFormat input_sample_fmt,
                                                                                      int64_t output_ch_layout,
                                                                                      int output_rate,
-                                                                                     AVSampleFormat output_sample_fmt) {
+                                                                                     AVSampleFormat output_sample_fmt,
+                                                                                     bool allow_fast_path) {
     auto tmp_resampler = audio_resampler_obj(input_ch_layout,
                                              input_rate,
                                              input_sample_fmt,
@@ -19,6 +22,22 @@ std::unique_ptr<audio_resampler_obj> audio_resampler_obj::create_audio_resampler
     if (result != audio_resampler_err::SUCCESS) {
         return nullptr;
     }
+    // the simd resampler covers the rate-preserving pairs too, the scalar
+    // converter only takes what it leaves over
+    if (allow_fast_path) {
+        tmp_resampler.fast_path = audio_fast_resampler_obj::create_audio_fast_resampler_obj(input_ch_layout,
+                                                                                            input_rate,
+                                                                                            input_sample_fmt,
+                                                                                            output_ch_layout,
+                                                                                            output_rate,
+                                                                                            output_sample_fmt);
+    }
+    if (allow_fast_path && input_rate == output_rate && tmp_resampler.fast_path == nullptr) {
+        tmp_resampler.direct_convert = find_audio_sample_converter(input_sample_fmt,
+                                                                   input_ch_layout,
+                                                                   output_sample_fmt,
+                                                                   output_ch_layout);
+    }
 
     return std::make_unique<audio_resampler_obj>(std::move(tmp_resampler));
 }
@@ -27,21 +46,32 @@ audio_resampler_obj::~audio_resampler_obj() {
     if (swr_ctx != nullptr){
         swr_free(&swr_ctx);
     }
+    free_dst_samples();
 }
 
 audio_resampler_obj::audio_resampler_obj(audio_resampler_obj &&other) noexcept :
     src_ch_layout(other.src_ch_layout),
     src_rate(other.src_rate),
     src_sample_fmt(other.src_sample_fmt),
-    dst_ch_layout(other.src_ch_layout),
+    dst_ch_layout(other.dst_ch_layout),
     dst_rate(other.dst_rate),
     dst_sample_fmt(other.dst_sample_fmt),
     src_nb_channels(other.src_nb_channels),
     dst_nb_channels(other.dst_nb_channels),
-    output_buffsize(other.output_buffsize) {
-
+    output_buffsize(other.output_buffsize),
+    output_nb_samples(other.output_nb_samples),
+    output_planes(std::move(other.output_planes)),
+    dst_data(other.dst_data),
+    dst_linesize(other.dst_linesize),
+    dst_capacity_nb_samples(other.dst_capacity_nb_samples),
+    dst_alloc_count(other.dst_alloc_count) {
+
+    fast_path = std::move(other.fast_path);
+    direct_convert = other.direct_convert;
     swr_ctx = other.swr_ctx;
     other.swr_ctx = nullptr;
+    other.dst_data = nullptr;
+    other.dst_capacity_nb_samples = 0;
 }
 
 audio_resampler_obj &audio_resampler_obj::operator=(audio_resampler_obj &&other) noexcept {
@@ -54,113 +84,188 @@ audio_resampler_obj &audio_resampler_obj::operator=(audio_resampler_obj &&other)
     }
     swr_ctx = other.swr_ctx;
     other.swr_ctx = nullptr;
+    fast_path = std::move(other.fast_path);
+    direct_convert = other.direct_convert;
+
+    free_dst_samples();
+    dst_data = other.dst_data;
+    dst_linesize = other.dst_linesize;
+    dst_capacity_nb_samples = other.dst_capacity_nb_samples;
+    dst_alloc_count = other.dst_alloc_count;
+    other.dst_data = nullptr;
+    other.dst_capacity_nb_samples = 0;
 
     src_ch_layout = other.src_ch_layout;
     src_rate = other.src_rate;
     src_sample_fmt = other.src_sample_fmt;
 
-    dst_ch_layout = other.src_ch_layout;
+    dst_ch_layout = other.dst_ch_layout;
     dst_rate = other.dst_rate;
     dst_sample_fmt = other.dst_sample_fmt;
 
     src_nb_channels = other.src_nb_channels;
     dst_nb_channels = other.dst_nb_channels;
     output_buffsize = other.output_buffsize;
+    output_nb_samples = other.output_nb_samples;
+    output_planes = std::move(other.output_planes);
 
     return *this;
 }
 
-const auto samples_deleter = [](uint8_t*** sample) {
-    if (sample != nullptr) {
-        av_freep(sample[0]);
-    }
-    av_freep(sample);
-};
-
-using samples_arr = std::unique_ptr<u_int8_t** [], decltype(samples_deleter)>;
-
-audio_resampler_err audio_resampler_obj::convert(AVFrame *frame, std::vector<std::vector<uint8_t> > &data_storage) {
+audio_resampler_err audio_resampler_obj::convert(AVFrame *frame) {
 
-    uint8_t **src_data = nullptr;
-    uint8_t **dst_data = nullptr;
-    int src_linesize = 0;
-    int dst_linesize = 0;
-    int output_nb_samples = 0;
+    if (direct_convert != nullptr) {
+        auto result = reserve_dst_samples(frame->nb_samples);
+        if (result != audio_resampler_err::SUCCESS) {
+            return result;
+        }
+        direct_convert(frame->extended_data, dst_data, frame->nb_samples);
+        return expose_output(frame->nb_samples);
+    }
 
-    // src buffer
-    auto result = av_samples_alloc_array_and_samples(&src_data,
-                                                     &src_linesize,
-                                                     src_nb_channels,
-                                                     frame->nb_samples,
-                                                     src_sample_fmt,
-                                                     0);
-    if (result < 0) {
-        return audio_resampler_err::ALLOC_SRC_SAMPLES_ERR;
+    if (fast_path != nullptr) {
+        auto result = reserve_dst_samples(fast_path->get_max_output_samples(frame->nb_samples));
+        if (result != audio_resampler_err::SUCCESS) {
+            return result;
+        }
+        output_nb_samples = fast_path->convert(frame->extended_data,
+                                               frame->nb_samples,
+                                               reinterpret_cast<int16_t *>(dst_data[0]),
+                                               dst_capacity_nb_samples);
+        output_buffsize = output_nb_samples * static_cast<int>(sizeof(int16_t));
+        output_planes[0] = std::span<const uint8_t>(dst_data[0], static_cast<size_t>(output_buffsize));
+        return audio_resampler_err::SUCCESS;
     }
-    samples_arr src(&src_data);
+
+    int max_nb_samples = 0;
 
     /* compute the number of converted samples: buffering is avoided
      * ensuring that the output buffer will contain at least all the
-     * converted input samples */
-    auto tmp_nb_samples = av_rescale_rnd(frame->nb_samples,
+     * converted input samples (including the ones delayed by swr) */
+    auto tmp_nb_samples = av_rescale_rnd(swr_get_delay(swr_ctx, src_rate) + frame->nb_samples,
                                          dst_rate,
                                          src_rate,
                                          AV_ROUND_UP);
     if ((tmp_nb_samples < INT_MAX) && (tmp_nb_samples > INT_MIN)) {
-        output_nb_samples = static_cast<int>(tmp_nb_samples);
+        max_nb_samples = static_cast<int>(tmp_nb_samples);
     } else {
         return audio_resampler_err::OUTPUT_NB_SAMPLES_ERR;
     }
 
-    // dst buffer
-    result = av_samples_alloc_array_and_samples(&dst_data,
-                                                &dst_linesize,
-                                                dst_nb_channels,
-                                                output_nb_samples,
-                                                dst_sample_fmt,
-                                                0);
-    if (result < 0) {
-        return audio_resampler_err::ALLOC_DST_SAMPLES_ERR;
-    }
-    samples_arr dst(&dst_data);
-
-    // convert to destination format
-    auto st_line_size = static_cast<size_t>(src_linesize);
-    for (int i = 0; i < src_nb_channels; ++i) {
-        memcpy(src_data[i], frame->extended_data[i], st_line_size);
+    // dst buffer grows only when more capacity is needed
+    auto result = reserve_dst_samples(max_nb_samples);
+    if (result != audio_resampler_err::SUCCESS) {
+        return result;
     }
 
+    // convert to destination format, frame planes are read directly
     auto current_samples_amount = swr_convert(swr_ctx,
                                               dst_data,
-                                              output_nb_samples,
-                                              const_cast<const uint8_t **>(src_data),
+                                              max_nb_samples,
+                                              const_cast<const uint8_t **>(frame->extended_data),
                                               frame->nb_samples);
     if (current_samples_amount < 0) {
         return audio_resampler_err::CONVERTING_ERR;
     }
 
-    // store result data to storage
-    auto dst_bufsize = av_samples_get_buffer_size(&dst_linesize,
-                                                  dst_nb_channels,
-                                                  current_samples_amount,
-                                                  dst_sample_fmt,
-                                                  1);
-    if (dst_bufsize < 0) {
-        return audio_resampler_err::DST_SAMPLE_BUF_SIZE_ERR;
+    return expose_output(current_samples_amount);
+}
+
+audio_resampler_err audio_resampler_obj::flush() {
+
+    // plain format conversions hold nothing back
+    if (direct_convert != nullptr) {
+        return expose_output(0);
     }
-    output_buffsize = dst_bufsize;
 
-    for (int i = 0; i < dst_nb_channels; ++i) {
-        data_storage.emplace_back(dst_data[i], dst_data[i] + dst_bufsize);
+    if (fast_path != nullptr) {
+        auto result = reserve_dst_samples(fast_path->get_max_flush_samples());
+        if (result != audio_resampler_err::SUCCESS) {
+            return result;
+        }
+        output_nb_samples = fast_path->flush(reinterpret_cast<int16_t *>(dst_data[0]), dst_capacity_nb_samples);
+        output_buffsize = output_nb_samples * static_cast<int>(sizeof(int16_t));
+        output_planes[0] = std::span<const uint8_t>(dst_data[0], static_cast<size_t>(output_buffsize));
+        return audio_resampler_err::SUCCESS;
     }
 
-    return audio_resampler_err::SUCCESS;
+    int max_nb_samples = 0;
+    auto tmp_nb_samples = av_rescale_rnd(swr_get_delay(swr_ctx, src_rate), dst_rate, src_rate, AV_ROUND_UP);
+    if ((tmp_nb_samples < INT_MAX) && (tmp_nb_samples > INT_MIN)) {
+        max_nb_samples = static_cast<int>(tmp_nb_samples);
+    } else {
+        return audio_resampler_err::OUTPUT_NB_SAMPLES_ERR;
+    }
+    if (max_nb_samples == 0) {
+        return expose_output(0);
+    }
+
+    auto result = reserve_dst_samples(max_nb_samples);
+    if (result != audio_resampler_err::SUCCESS) {
+        return result;
+    }
+
+    // no input drains the delay line
+    auto current_samples_amount = swr_convert(swr_ctx, dst_data, max_nb_samples, nullptr, 0);
+    if (current_samples_amount < 0) {
+        return audio_resampler_err::CONVERTING_ERR;
+    }
+
+    return expose_output(current_samples_amount);
 }
 
 int audio_resampler_obj::get_output_buf_size() const {
     return output_buffsize;
 }
 
+std::span<const std::span<const uint8_t> > audio_resampler_obj::get_output_planes() const {
+    return output_planes;
+}
+
+int audio_resampler_obj::get_output_nb_samples() const {
+    return output_nb_samples;
+}
+
+std::uint64_t audio_resampler_obj::get_dst_alloc_count() const {
+    return dst_alloc_count;
+}
+
+std::size_t audio_resampler_obj::get_dst_buffer_bytes() const {
+    if (dst_data == nullptr) {
+        return 0;
+    }
+    return static_cast<std::size_t>(dst_linesize) * static_cast<std::size_t>(av_sample_fmt_is_planar(dst_sample_fmt) ? dst_nb_channels : 1);
+}
+
+audio_resampler_err audio_resampler_obj::reset() {
+    // re-initializing with unchanged options keeps the resample filter and
+    // only clears the buffered samples
+    if ((swr_init(swr_ctx)) < 0) {
+        return audio_resampler_err::INIT_SWR_CTX_ERR;
+    }
+    if (fast_path != nullptr) {
+        fast_path->reset();
+    }
+    output_nb_samples = 0;
+    output_buffsize = 0;
+
+    return audio_resampler_err::SUCCESS;
+}
+
+bool audio_resampler_obj::is_fast_path() const {
+    return fast_path != nullptr || direct_convert != nullptr;
+}
+
+const char *audio_resampler_obj::get_backend_name() const {
+    if (direct_convert != nullptr) {
+        return "template";
+    }
+    if (fast_path != nullptr) {
+        return get_audio_simd_kernels().name;
+    }
+    return "swr";
+}
+
 // private methods
 
 audio_resampler_obj::audio_resampler_obj(int64_t input_ch_layout,
@@ -205,5 +310,75 @@ audio_resampler_err audio_resampler_obj::init_audio_resampler() {
     src_nb_channels = av_get_channel_layout_nb_channels(static_cast<std::uint64_t>(src_ch_layout));
     dst_nb_channels = av_get_channel_layout_nb_channels(static_cast<std::uint64_t>(dst_ch_layout));
 
+    // one view per dst plane, refreshed in place on every convert
+    auto nb_planes = av_sample_fmt_is_planar(dst_sample_fmt) ? dst_nb_channels : 1;
+    output_planes.resize(static_cast<size_t>(nb_planes));
+
+    return audio_resampler_err::SUCCESS;
+}
+
+audio_resampler_err audio_resampler_obj::reserve_dst_samples(int nb_samples) {
+    if (nb_samples <= dst_capacity_nb_samples) {
+        return audio_resampler_err::SUCCESS;
+    }
+
+    free_dst_samples();
+
+    auto result = av_samples_alloc_array_and_samples(&dst_data,
+                                                     &dst_linesize,
+                                                     dst_nb_channels,
+                                                     nb_samples,
+                                                     dst_sample_fmt,
+                                                     0);
+    if (result < 0) {
+        dst_data = nullptr;
+        return audio_resampler_err::ALLOC_DST_SAMPLES_ERR;
+    }
+    dst_capacity_nb_samples = nb_samples;
+    ++dst_alloc_count;
+
+    return audio_resampler_err::SUCCESS;
+}
+
+audio_resampler_err audio_resampler_obj::expose_output(int nb_samples) {
+    // nothing produced (filter still filling, empty flush), the buffer size helper rejects 0
+    if (nb_samples == 0) {
+        output_buffsize = 0;
+        output_nb_samples = 0;
+        std::fill(output_planes.begin(), output_planes.end(), std::span<const uint8_t>());
+        return audio_resampler_err::SUCCESS;
+    }
+
+    // expose result data as views into the dst buffers
+    int out_linesize = 0;
+    auto dst_bufsize = av_samples_get_buffer_size(&out_linesize,
+                                                  dst_nb_channels,
+                                                  nb_samples,
+                                                  dst_sample_fmt,
+                                                  1);
+    if (dst_bufsize < 0) {
+        return audio_resampler_err::DST_SAMPLE_BUF_SIZE_ERR;
+    }
+
+    // packed formats keep all channels in plane 0, planar ones one channel per plane
+    if (av_sample_fmt_is_planar(dst_sample_fmt)) {
+        dst_bufsize = out_linesize;
+    }
+    output_buffsize = dst_bufsize;
+    output_nb_samples = nb_samples;
+
+    for (size_t i = 0; i < output_planes.size(); ++i) {
+        output_planes[i] = std::span<const uint8_t>(dst_data[i], static_cast<size_t>(dst_bufsize));
+    }
+
     return audio_resampler_err::SUCCESS;
-}
\ No newline at end of file
+}
+
+void audio_resampler_obj::free_dst_samples() {
+    if (dst_data != nullptr) {
+        av_freep(&dst_data[0]);
+    }
+    av_freep(&dst_data);
+    dst_capacity_nb_samples = 0;
+    dst_linesize = 0;
+}
@@ -1,7 +1,13 @@
+#pragma once
+
 #include <memory>
 #include <vector>
+#include <span>
 #include <cstdint>
 
+#include "audio_fast_resampler.h"
+#include "audio_sample_converter.h"
+
 extern "C" {
 #include <libswresample/swresample.h>
 #include <libavutil/opt.h>
@@ -27,7 +33,8 @@ public:
                                                                            AVSampleFormat input_sample_fmt,
                                                                            int64_t output_ch_layout,
                                                                            int output_rate,
-                                                                           AVSampleFormat output_sample_fmt);
+                                                                           AVSampleFormat output_sample_fmt,
+                                                                           bool allow_fast_path = true);
     ~audio_resampler_obj();
     // Disallow copying
     audio_resampler_obj(audio_resampler_obj &other) = delete;
@@ -36,12 +43,33 @@ public:
     audio_resampler_obj(audio_resampler_obj &&other) noexcept ;
     audio_resampler_obj &operator=(audio_resampler_obj &&other) noexcept;
 
-    audio_resampler_err convert(AVFrame *frame, std::vector<std::vector<uint8_t> > &data_storage);
+    audio_resampler_err convert(AVFrame *frame);
+    // end of stream: outputs the samples still delayed in the filter through the
+    // same views as convert, reset before converting another stream
+    audio_resampler_err flush();
     int get_output_buf_size() const;
+    // views into the internal dst buffers, valid until the next convert call
+    std::span<const std::span<const uint8_t> > get_output_planes() const;
+    int get_output_nb_samples() const;
+    // number of times the dst buffers were (re)allocated, stays constant after warm-up
+    std::uint64_t get_dst_alloc_count() const;
+    // bytes held by the dst buffers
+    std::size_t get_dst_buffer_bytes() const;
+    // drops the samples buffered from the previous stream so the instance can be reused
+    audio_resampler_err reset();
+    // true when the conversion bypasses swr
+    bool is_fast_path() const;
+    // "swr", "template" or the vector kernel set of the fast path
+    const char *get_backend_name() const;
 
 private:
 
     SwrContext *swr_ctx;
+    // common "to s16 mono" pairs, swr handles everything else
+    std::unique_ptr<audio_fast_resampler_obj> fast_path;
+    // same rate mono / stereo format conversions the fast path does not cover,
+    // specialized at compile time
+    audio_sample_convert_fn direct_convert = nullptr;
 
     int64_t src_ch_layout;
     int src_rate;
@@ -54,6 +82,14 @@ private:
     int src_nb_channels = 0;
     int dst_nb_channels = 0;
     int output_buffsize = 0;
+    int output_nb_samples = 0;
+    std::vector<std::span<const uint8_t> > output_planes;
+
+    // persistent grow-only dst buffers
+    uint8_t **dst_data = nullptr;
+    int dst_linesize = 0;
+    int dst_capacity_nb_samples = 0;
+    std::uint64_t dst_alloc_count = 0;
 
     explicit audio_resampler_obj(int64_t input_ch_layout,
                                  int input_rate,
@@ -63,4 +99,7 @@ private:
                                  AVSampleFormat output_sample_fmt);
 
     audio_resampler_err init_audio_resampler();
+    audio_resampler_err reserve_dst_samples(int nb_samples);
+    audio_resampler_err expose_output(int nb_samples);
+    void free_dst_samples();
 };
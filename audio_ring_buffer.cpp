@@ -0,0 +1,91 @@
+#include "audio_ring_buffer.h"
+#include "audio_demuxer.h"
+
+#include <algorithm>
+#include <cstring>
+
+audio_ring_buffer_obj::audio_ring_buffer_obj(size_t capacity_bytes) :
+        storage(std::max<size_t>(capacity_bytes, 1)),
+        read_pos(0),
+        used(0),
+        closed(false),
+        cancelled(false) {
+
+}
+
+std::error_code audio_ring_buffer_obj::consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    if (planes.size() > 1 && nb_samples > 0) {
+        auto sample_size = planes[0].size() / static_cast<size_t>(nb_samples);
+        interleaved.resize(planes.size() * planes[0].size());
+        audio_interleave_planes(planes, nb_samples, sample_size, interleaved.data());
+        return write(interleaved);
+    }
+    for (auto & item : planes) {
+        auto result = write(item);
+        if (result) {
+            return result;
+        }
+    }
+    return audio_demuxer_errc::SUCCESS;
+}
+
+std::error_code audio_ring_buffer_obj::write(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        std::unique_lock lock(guard);
+        not_full.wait(lock, [this]() { return cancelled || used < storage.size(); });
+        if (cancelled) {
+            return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+        }
+
+        // copy as much as fits, at most up to the physical end of the storage
+        auto write_pos = (read_pos + used) % storage.size();
+        auto chunk = std::min({data.size(), storage.size() - used, storage.size() - write_pos});
+        memcpy(storage.data() + write_pos, data.data(), chunk);
+        used += chunk;
+        data = data.subspan(chunk);
+
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+void audio_ring_buffer_obj::close() {
+    {
+        std::lock_guard lock(guard);
+        closed = true;
+    }
+    not_empty.notify_all();
+}
+
+size_t audio_ring_buffer_obj::read(std::span<uint8_t> out) {
+    std::unique_lock lock(guard);
+    not_empty.wait(lock, [this]() { return cancelled || closed || used > 0; });
+    if (cancelled || used == 0) {
+        return 0;
+    }
+
+    auto chunk = std::min({out.size(), used, storage.size() - read_pos});
+    memcpy(out.data(), storage.data() + read_pos, chunk);
+    read_pos = (read_pos + chunk) % storage.size();
+    used -= chunk;
+
+    lock.unlock();
+    not_full.notify_one();
+
+    return chunk;
+}
+
+void audio_ring_buffer_obj::cancel() {
+    {
+        std::lock_guard lock(guard);
+        cancelled = true;
+    }
+    not_full.notify_all();
+    not_empty.notify_all();
+}
+
+size_t audio_ring_buffer_obj::capacity() const {
+    return storage.size();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include "audio_sink.h"
+
+// fixed-capacity single producer / single consumer byte ring
+// the decoding thread writes through the sink interface and blocks while the
+// ring is full (backpressure), the consumer thread reads while decoding runs
+
+class audio_ring_buffer_obj final : public audio_sink_obj {
+public:
+    explicit audio_ring_buffer_obj(size_t capacity_bytes);
+
+    // Disallow copying
+    audio_ring_buffer_obj(audio_ring_buffer_obj &other) = delete;
+    audio_ring_buffer_obj &operator=(audio_ring_buffer_obj &other) = delete;
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override;
+
+    // producer side
+    std::error_code write(std::span<const uint8_t> data);
+    void close();
+
+    // consumer side
+    // blocks until at least one byte is available, returns 0 once the ring
+    // is closed and drained
+    size_t read(std::span<uint8_t> out);
+    void cancel();
+
+    size_t capacity() const;
+
+private:
+    std::vector<uint8_t>    storage;
+    size_t                  read_pos;
+    size_t                  used;
+    bool                    closed;
+    bool                    cancelled;
+    std::vector<uint8_t>    interleaved;   // producer side only
+
+    std::mutex              guard;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
@@ -0,0 +1,91 @@
+#include "audio_sample_converter.h"
+
+#include <array>
+#include <utility>
+
+namespace {
+
+// formats covered by the dispatch table, in table order
+
+template<AVSampleFormat Format>
+struct audio_format_traits;
+
+template<> struct audio_format_traits<AV_SAMPLE_FMT_S16> { using type = int16_t; static constexpr auto planarity = audio_planarity::interleaved; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_S32> { using type = int32_t; static constexpr auto planarity = audio_planarity::interleaved; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_FLT> { using type = float; static constexpr auto planarity = audio_planarity::interleaved; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_DBL> { using type = double; static constexpr auto planarity = audio_planarity::interleaved; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_S16P> { using type = int16_t; static constexpr auto planarity = audio_planarity::planar; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_S32P> { using type = int32_t; static constexpr auto planarity = audio_planarity::planar; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_FLTP> { using type = float; static constexpr auto planarity = audio_planarity::planar; };
+template<> struct audio_format_traits<AV_SAMPLE_FMT_DBLP> { using type = double; static constexpr auto planarity = audio_planarity::planar; };
+
+constexpr std::array<AVSampleFormat, 8> table_formats = {
+    AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_DBL,
+    AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_DBLP,
+};
+
+// (src channels, dst channels)
+constexpr std::array<std::pair<int, int>, 4> table_channels = {{
+    {1, 1}, {2, 2}, {2, 1}, {1, 2},
+}};
+
+constexpr size_t table_size = table_formats.size() * table_formats.size() * table_channels.size();
+
+// entry index = (src format * formats + dst format) * channel pairs + channel pair
+template<size_t Index>
+constexpr audio_sample_convert_fn make_table_entry() {
+    constexpr auto channel_pair = table_channels[Index % table_channels.size()];
+    constexpr auto dst_format = table_formats[(Index / table_channels.size()) % table_formats.size()];
+    constexpr auto src_format = table_formats[Index / table_channels.size() / table_formats.size()];
+    using src_traits = audio_format_traits<src_format>;
+    using dst_traits = audio_format_traits<dst_format>;
+
+    return &converter<typename src_traits::type, src_traits::planarity, channel_pair.first,
+                      typename dst_traits::type, dst_traits::planarity, channel_pair.second>::convert;
+}
+
+template<size_t... Indexes>
+constexpr std::array<audio_sample_convert_fn, table_size> make_table(std::index_sequence<Indexes...>) {
+    return {make_table_entry<Indexes>()...};
+}
+
+constexpr auto converter_table = make_table(std::make_index_sequence<table_size>());
+
+int find_format(AVSampleFormat format) {
+    auto it = std::find(table_formats.begin(), table_formats.end(), format);
+    return it == table_formats.end() ? -1 : static_cast<int>(it - table_formats.begin());
+}
+
+int layout_channels(int64_t ch_layout) {
+    if (ch_layout == AV_CH_LAYOUT_MONO) {
+        return 1;
+    }
+    if (ch_layout == AV_CH_LAYOUT_STEREO) {
+        return 2;
+    }
+    return 0;
+}
+
+}
+
+audio_sample_convert_fn find_audio_sample_converter(AVSampleFormat src_fmt,
+                                                    int64_t src_ch_layout,
+                                                    AVSampleFormat dst_fmt,
+                                                    int64_t dst_ch_layout) {
+    auto src_index = find_format(src_fmt);
+    auto dst_index = find_format(dst_fmt);
+    if (src_index < 0 || dst_index < 0) {
+        return nullptr;
+    }
+
+    auto channels = std::make_pair(layout_channels(src_ch_layout), layout_channels(dst_ch_layout));
+    auto pair = std::find(table_channels.begin(), table_channels.end(), channels);
+    if (pair == table_channels.end()) {
+        return nullptr;
+    }
+
+    auto index = (static_cast<size_t>(src_index) * table_formats.size() + static_cast<size_t>(dst_index)) * table_channels.size() +
+                 static_cast<size_t>(pair - table_channels.begin());
+
+    return converter_table[index];
+}
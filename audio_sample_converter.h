@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+#include <libavutil/channel_layout.h>
+}
+
+// compile-time specialized sample format / channel conversion without a rate change
+// converter<float, audio_planarity::planar, 2, int16_t, audio_planarity::interleaved, 1>
+// is fully known to the compiler, so the per-sample loop gets unrolled and vectorized
+// sample scaling, rounding and saturation follow swr, channel mixing uses the
+// coefficients swr's default matrix ends up with for mono / stereo
+
+enum class audio_planarity {
+    planar,
+    interleaved,
+};
+
+using audio_sample_convert_fn = void (*)(const uint8_t * const *src, uint8_t * const *dst, int nb_samples);
+
+template<typename T>
+inline constexpr bool audio_is_float_sample_v = std::is_floating_point_v<T>;
+
+// round half to even like lrint, without the libm call that keeps loops scalar:
+// adding 1.5 * 2^mantissa bits pushes the fraction out of the mantissa; larger
+// values stay out of the sample range, so rounding before the clamp is exact
+template<typename T>
+inline T audio_round_sample(T value) {
+    constexpr T magic = std::is_same_v<T, float> ? T(12582912.0) : T(6755399441055744.0);
+    return (value + magic) - magic;
+}
+
+template<typename Dst, typename Src>
+inline Dst audio_convert_sample(Src value) {
+    if constexpr (std::is_same_v<Src, Dst>) {
+        return value;
+    } else if constexpr (audio_is_float_sample_v<Src> && audio_is_float_sample_v<Dst>) {
+        return static_cast<Dst>(value);
+    } else if constexpr (std::is_same_v<Src, int16_t> && std::is_same_v<Dst, int32_t>) {
+        return static_cast<int32_t>(static_cast<uint32_t>(value) << 16);
+    } else if constexpr (std::is_same_v<Src, int32_t> && std::is_same_v<Dst, int16_t>) {
+        return static_cast<int16_t>(value >> 16);
+    } else if constexpr (std::is_same_v<Src, int16_t>) {
+        return static_cast<Dst>(value * (1.0 / (1 << 15)));
+    } else if constexpr (std::is_same_v<Src, int32_t>) {
+        return static_cast<Dst>(value * (1.0 / (1U << 31)));
+    } else if constexpr (std::is_same_v<Dst, int16_t>) {
+        // clamped after rounding, the other order keeps gcc from vectorizing
+        auto rounded = audio_round_sample(static_cast<float>(value) * 32768.0f);
+        return static_cast<int16_t>(static_cast<int32_t>(std::min(std::max(rounded, -32768.0f), 32767.0f)));
+    } else {
+        static_assert(std::is_same_v<Dst, int32_t>);
+        auto rounded = audio_round_sample(static_cast<double>(value) * 2147483648.0);
+        return static_cast<int32_t>(std::min(std::max(rounded, -2147483648.0), 2147483647.0));
+    }
+}
+
+template<typename SrcT, audio_planarity SrcPlanarity, int SrcChannels,
+         typename DstT, audio_planarity DstPlanarity, int DstChannels>
+struct converter {
+    static_assert(SrcChannels == DstChannels || SrcChannels == 1 || DstChannels == 1,
+                  "only copies, downmixes to mono and upmixes from mono are supported");
+    static_assert(SrcChannels <= 2 && DstChannels <= 2, "mono and stereo only");
+
+    // mixing happens in float, in double when either side is double
+    using mix_type = std::conditional_t<std::is_same_v<SrcT, double> || std::is_same_v<DstT, double>, double, float>;
+
+    // swr normalizes the stereo to mono matrix for integer output only
+    static constexpr mix_type downmix_gain = audio_is_float_sample_v<DstT> ? mix_type(M_SQRT1_2) : mix_type(0.5);
+    static constexpr mix_type upmix_gain = mix_type(M_SQRT1_2);
+
+    // distance between two samples of one channel
+    static constexpr int src_step = SrcPlanarity == audio_planarity::planar ? 1 : SrcChannels;
+    static constexpr int dst_step = DstPlanarity == audio_planarity::planar ? 1 : DstChannels;
+
+    static void convert(const uint8_t * const *src, uint8_t * const *dst, int nb_samples) {
+        // one restrict pointer per channel with a constant step, the loops below
+        // are branch free and vectorize for every instantiation
+        const SrcT *__restrict in0 = reinterpret_cast<const SrcT *>(src[0]);
+        DstT *__restrict out0 = reinterpret_cast<DstT *>(dst[0]);
+
+        if constexpr (SrcChannels == 1 && DstChannels == 1) {
+            for (int i = 0; i < nb_samples; ++i) {
+                out0[i] = audio_convert_sample<DstT>(in0[i]);
+            }
+        } else if constexpr (SrcChannels == 2 && DstChannels == 2) {
+            const SrcT *__restrict in1 = SrcPlanarity == audio_planarity::planar ? reinterpret_cast<const SrcT *>(src[1]) : in0 + 1;
+            DstT *__restrict out1 = DstPlanarity == audio_planarity::planar ? reinterpret_cast<DstT *>(dst[1]) : out0 + 1;
+            for (int i = 0; i < nb_samples; ++i) {
+                out0[i * dst_step] = audio_convert_sample<DstT>(in0[i * src_step]);
+                out1[i * dst_step] = audio_convert_sample<DstT>(in1[i * src_step]);
+            }
+        } else if constexpr (DstChannels == 1) {
+            const SrcT *__restrict in1 = SrcPlanarity == audio_planarity::planar ? reinterpret_cast<const SrcT *>(src[1]) : in0 + 1;
+            for (int i = 0; i < nb_samples; ++i) {
+                auto sum = audio_convert_sample<mix_type>(in0[i * src_step]) + audio_convert_sample<mix_type>(in1[i * src_step]);
+                out0[i] = audio_convert_sample<DstT>(sum * downmix_gain);
+            }
+        } else {
+            DstT *__restrict out1 = DstPlanarity == audio_planarity::planar ? reinterpret_cast<DstT *>(dst[1]) : out0 + 1;
+            for (int i = 0; i < nb_samples; ++i) {
+                auto mixed = audio_convert_sample<DstT>(audio_convert_sample<mix_type>(in0[i]) * upmix_gain);
+                out0[i * dst_step] = mixed;
+                out1[i * dst_step] = mixed;
+            }
+        }
+    }
+};
+
+// runtime dispatch over the instantiations for s16 / s32 / flt / dbl, packed and
+// planar, mono and stereo, nullptr when the pair is not covered
+audio_sample_convert_fn find_audio_sample_converter(AVSampleFormat src_fmt,
+                                                    int64_t src_ch_layout,
+                                                    AVSampleFormat dst_fmt,
+                                                    int64_t dst_ch_layout);
@@ -0,0 +1,220 @@
+#include "audio_seek_index.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+namespace {
+
+constexpr std::array<char, 4> index_magic = {'A', 'D', 'I', 'X'};
+constexpr std::uint32_t index_version = 1;
+constexpr std::streamoff identity_hash_bytes = 64 * 1024;
+
+void put_varint(std::vector<uint8_t> &out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool get_varint(const uint8_t *&data, const uint8_t *end, std::uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        auto byte = *data++;
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint64_t zigzag(std::int64_t value) {
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value) {
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+void fnv1a(std::uint64_t &hash, const char *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+template<typename T>
+void put_raw(std::vector<uint8_t> &out, const T &value) {
+    auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+bool get_raw(const uint8_t *&data, const uint8_t *end, T &value) {
+    if (static_cast<size_t>(end - data) < sizeof(T)) {
+        return false;
+    }
+    memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return true;
+}
+
+}
+
+audio_seek_index_obj::audio_seek_index_obj() :
+        stream_index(-1),
+        tb_num(0),
+        tb_den(1) {
+
+}
+
+void audio_seek_index_obj::clear() {
+    entries.clear();
+}
+
+void audio_seek_index_obj::set_stream(int index, int time_base_num, int time_base_den) {
+    stream_index = index;
+    tb_num = time_base_num;
+    tb_den = time_base_den;
+}
+
+void audio_seek_index_obj::add(std::int64_t pts, std::int64_t pos) {
+    entries.push_back({pts, pos});
+}
+
+bool audio_seek_index_obj::find(std::int64_t pts, audio_seek_index_entry &entry) const {
+    auto it = std::upper_bound(entries.begin(), entries.end(), pts, [](std::int64_t value, const audio_seek_index_entry &item) {
+        return value < item.pts;
+    });
+    if (it == entries.begin()) {
+        return false;
+    }
+    entry = *(it - 1);
+    return true;
+}
+
+size_t audio_seek_index_obj::size() const {
+    return entries.size();
+}
+
+bool audio_seek_index_obj::matches(int index, int time_base_num, int time_base_den) const {
+    return stream_index == index && tb_num == time_base_num && tb_den == time_base_den;
+}
+
+bool audio_seek_index_obj::save(const std::filesystem::path &sidecar_file, const audio_file_identity &identity) const {
+    std::vector<uint8_t> data;
+    data.insert(data.end(), index_magic.begin(), index_magic.end());
+    put_raw(data, index_version);
+    put_raw(data, identity.size);
+    put_raw(data, identity.mtime_ns);
+    put_raw(data, identity.hash);
+    put_raw(data, static_cast<std::int32_t>(stream_index));
+    put_raw(data, static_cast<std::int32_t>(tb_num));
+    put_raw(data, static_cast<std::int32_t>(tb_den));
+    put_varint(data, entries.size());
+
+    audio_seek_index_entry previous {0, 0};
+    for (auto & item : entries) {
+        put_varint(data, zigzag(item.pts - previous.pts));
+        put_varint(data, zigzag(item.pos - previous.pos));
+        previous = item;
+    }
+
+    // write to a temporary file first so readers never see a partial index
+    auto tmp_file = sidecar_file;
+    tmp_file += ".tmp";
+    {
+        std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!out.good()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, sidecar_file, ec);
+
+    return !ec;
+}
+
+bool audio_seek_index_obj::load(const std::filesystem::path &sidecar_file, const audio_file_identity &identity) {
+    entries.clear();
+
+    std::ifstream in(sidecar_file, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const uint8_t *cursor = data.data();
+    const uint8_t *end = data.data() + data.size();
+
+    std::array<char, 4> magic {};
+    std::uint32_t version = 0;
+    audio_file_identity stored;
+    std::int32_t index = 0;
+    std::int32_t num = 0;
+    std::int32_t den = 0;
+    std::uint64_t amount = 0;
+    if (!get_raw(cursor, end, magic) || magic != index_magic ||
+        !get_raw(cursor, end, version) || version != index_version ||
+        !get_raw(cursor, end, stored.size) ||
+        !get_raw(cursor, end, stored.mtime_ns) ||
+        !get_raw(cursor, end, stored.hash) ||
+        !(stored == identity) ||
+        !get_raw(cursor, end, index) ||
+        !get_raw(cursor, end, num) ||
+        !get_raw(cursor, end, den) ||
+        !get_varint(cursor, end, amount)) {
+        return false;
+    }
+
+    audio_seek_index_entry previous {0, 0};
+    entries.reserve(static_cast<size_t>(std::min<std::uint64_t>(amount, data.size())));
+    for (std::uint64_t i = 0; i < amount; ++i) {
+        std::uint64_t pts_delta = 0;
+        std::uint64_t pos_delta = 0;
+        if (!get_varint(cursor, end, pts_delta) || !get_varint(cursor, end, pos_delta)) {
+            entries.clear();
+            return false;
+        }
+        previous.pts += unzigzag(pts_delta);
+        previous.pos += unzigzag(pos_delta);
+        entries.push_back(previous);
+    }
+    set_stream(index, num, den);
+
+    return true;
+}
+
+bool audio_seek_index_obj::get_file_identity(const std::filesystem::path &file, audio_file_identity &identity) {
+    struct stat file_stat {};
+    if (stat(file.c_str(), &file_stat) < 0) {
+        return false;
+    }
+    identity.size = static_cast<std::uint64_t>(file_stat.st_size);
+    identity.mtime_ns = static_cast<std::int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::vector<char> buffer(static_cast<size_t>(identity_hash_bytes));
+    identity.hash = 0xcbf29ce484222325ULL;
+
+    in.read(buffer.data(), identity_hash_bytes);
+    fnv1a(identity.hash, buffer.data(), static_cast<size_t>(in.gcount()));
+
+    auto file_size = static_cast<std::streamoff>(identity.size);
+    if (file_size > identity_hash_bytes) {
+        in.clear();
+        in.seekg(std::max(file_size - identity_hash_bytes, identity_hash_bytes));
+        in.read(buffer.data(), identity_hash_bytes);
+        fnv1a(identity.hash, buffer.data(), static_cast<size_t>(in.gcount()));
+    }
+
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+
+// identity of an indexed media file, the index is only valid for the same identity
+
+struct audio_file_identity {
+    std::uint64_t   size = 0;
+    std::int64_t    mtime_ns = 0;
+    std::uint64_t   hash = 0;       // FNV-1a of the first and last 64 KiB
+
+    bool operator==(const audio_file_identity &other) const = default;
+};
+
+// position of a packet: pts in stream time base counted from the stream start
+// (the sample position at the stream rate) and its byte offset in the file
+
+struct audio_seek_index_entry {
+    std::int64_t    pts;
+    std::int64_t    pos;
+};
+
+// packet index built during a full pass and persisted in a sidecar file,
+// used for O(log n) byte seeks into formats without a reliable index
+
+class audio_seek_index_obj final {
+public:
+    audio_seek_index_obj();
+
+    void clear();
+    void set_stream(int stream_index, int time_base_num, int time_base_den);
+    // entries must be added in increasing pts order
+    void add(std::int64_t pts, std::int64_t pos);
+    // last entry with pts <= target, false when there is none
+    bool find(std::int64_t pts, audio_seek_index_entry &entry) const;
+
+    size_t size() const;
+    // true when the index was built for this stream and time base
+    bool matches(int stream_index, int time_base_num, int time_base_den) const;
+
+    // compact binary sidecar: header, then zigzag varint deltas of the entries
+    bool save(const std::filesystem::path &sidecar_file, const audio_file_identity &identity) const;
+    // fails when the sidecar is missing, corrupted or was built for another file
+    bool load(const std::filesystem::path &sidecar_file, const audio_file_identity &identity);
+
+    static bool get_file_identity(const std::filesystem::path &file, audio_file_identity &identity);
+
+private:
+
+    int                                 stream_index;
+    int                                 tb_num;
+    int                                 tb_den;
+    std::vector<audio_seek_index_entry> entries;
+};
@@ -0,0 +1,38 @@
+#include "audio_sink.h"
+#include "audio_demuxer.h"
+
+// fstream sink
+
+audio_fstream_sink_obj::audio_fstream_sink_obj(std::fstream &out_stream) :
+        out_fs(out_stream) {
+
+}
+
+std::error_code audio_fstream_sink_obj::consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    if (planes.size() > 1 && nb_samples > 0) {
+        auto sample_size = planes[0].size() / static_cast<size_t>(nb_samples);
+        interleaved.resize(planes.size() * planes[0].size());
+        audio_interleave_planes(planes, nb_samples, sample_size, interleaved.data());
+        out_fs.write(reinterpret_cast<const char *>(interleaved.data()), static_cast<std::streamsize>(interleaved.size()));
+    } else {
+        for (auto & item : planes) {
+            out_fs.write(reinterpret_cast<const char *>(item.data()), static_cast<std::streamsize>(item.size()));
+        }
+    }
+    if (!out_fs.good()) {
+        return audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    }
+
+    return audio_demuxer_errc::SUCCESS;
+}
+
+// callback sink
+
+audio_callback_sink_obj::audio_callback_sink_obj(callback_type callback) :
+        on_samples(std::move(callback)) {
+
+}
+
+std::error_code audio_callback_sink_obj::consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) {
+    return on_samples(planes, nb_samples);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+#include "audio_interleave.h"
+
+// consumer of converted samples
+// planes hold one span per plane (a single span for packed formats), the data
+// belongs to the caller and is only valid for the duration of the call
+// the byte stream sinks (file, memory, ring) store planar input interleaved
+
+class audio_sink_obj {
+public:
+    virtual ~audio_sink_obj() = default;
+
+    virtual std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) = 0;
+};
+
+// writes every plane to an already opened file stream
+
+class audio_fstream_sink_obj final : public audio_sink_obj {
+public:
+    explicit audio_fstream_sink_obj(std::fstream &out_stream);
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override;
+
+private:
+    std::fstream &out_fs;
+    std::vector<uint8_t> interleaved;
+};
+
+// forwards converted samples to a user callback
+
+class audio_callback_sink_obj final : public audio_sink_obj {
+public:
+    using callback_type = std::function<std::error_code(std::span<const std::span<const uint8_t> >, int)>;
+
+    explicit audio_callback_sink_obj(callback_type callback);
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override;
+
+private:
+    callback_type on_samples;
+};
+
+// appends converted samples to a growable contiguous buffer
+// (std::vector<uint8_t> or std::pmr::vector<uint8_t>)
+
+template<typename Container>
+class audio_memory_sink_obj final : public audio_sink_obj {
+public:
+    explicit audio_memory_sink_obj(Container &output) :
+            out_buffer(output) {
+
+    }
+
+    std::error_code consume(std::span<const std::span<const uint8_t> > planes, int nb_samples) override {
+        if (planes.size() == 1 || nb_samples <= 0) {
+            for (auto & item : planes) {
+                out_buffer.insert(out_buffer.end(), item.begin(), item.end());
+            }
+            return {};
+        }
+
+        // interleaved straight into the tail of the container
+        auto sample_size = planes[0].size() / static_cast<size_t>(nb_samples);
+        auto offset = out_buffer.size();
+        out_buffer.resize(offset + planes.size() * planes[0].size());
+        audio_interleave_planes(planes, nb_samples, sample_size, out_buffer.data() + offset);
+        return {};
+    }
+
+private:
+    Container &out_buffer;
+};
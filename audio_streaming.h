@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+// opt-in streaming mode for live inputs (named pipes, sockets): minimal probing,
+// no demuxer buffering, low-delay single-threaded decoding and serial output of
+// every frame as soon as it is decoded
+
+struct audio_streaming_options {
+    bool            enabled = false;
+    std::int64_t    probesize = 4096;           // bytes, used when the probe options leave it unset
+    std::int64_t    analyzeduration = 100000;   // microseconds, used when the probe options leave it unset
+    bool            nobuffer = true;            // AVFMT_FLAG_NOBUFFER
+    bool            direct_io = true;           // unbuffered avio reads for file paths
+};
+
+// latency distribution with power-of-two microsecond buckets, bucket i holds
+// values in [2^i, 2^(i+1)) us and bucket 0 everything below 2 us
+
+class audio_latency_histogram {
+public:
+    static constexpr size_t nb_buckets = 32;
+
+    void clear() {
+        *this = {};
+    }
+
+    void record(std::uint64_t latency_ns) {
+        auto latency_us = latency_ns / 1000;
+        auto bucket = latency_us < 2 ? 0 : static_cast<size_t>(std::bit_width(latency_us) - 1);
+        buckets[std::min(bucket, nb_buckets - 1)] += 1;
+        count += 1;
+        sum_ns += latency_ns;
+        min_ns = count == 1 ? latency_ns : std::min(min_ns, latency_ns);
+        max_ns = std::max(max_ns, latency_ns);
+    }
+
+    std::uint64_t get_count() const { return count; }
+    std::uint64_t get_min_ns() const { return min_ns; }
+    std::uint64_t get_max_ns() const { return max_ns; }
+    std::uint64_t get_mean_ns() const { return count == 0 ? 0 : sum_ns / count; }
+    std::uint64_t get_bucket(size_t index) const { return buckets[index]; }
+
+    // upper bound of the bucket holding the given percentile (0..100), clamped to the maximum
+    std::uint64_t get_percentile_ns(double percentile) const {
+        if (count == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(percentile / 100.0 * static_cast<double>(count));
+        std::uint64_t seen = 0;
+        for (size_t i = 0; i < nb_buckets; ++i) {
+            seen += buckets[i];
+            if (seen > rank) {
+                return std::min((std::uint64_t(2) << i) * 1000, max_ns);
+            }
+        }
+        return max_ns;
+    }
+
+private:
+    std::array<std::uint64_t, nb_buckets> buckets {};
+    std::uint64_t   count = 0;
+    std::uint64_t   sum_ns = 0;
+    std::uint64_t   min_ns = 0;
+    std::uint64_t   max_ns = 0;
+};
@@ -1,8 +1,76 @@
 #include <iostream>
+#include <string>
+#include <fstream>
 
 #include "audio_demuxer.h"
+#include "audio_batch.h"
 
-int main() {
+int run_batch(const std::filesystem::path &manifest_file,
+              int output_sample_rate_hz,
+              AVSampleFormat output_format,
+              int64_t output_ch_layout) {
+    std::vector<audio_batch_job> jobs;
+    auto result = audio_batch_obj::read_manifest(manifest_file, jobs);
+    if (result != audio_demuxer_errc::SUCCESS) {
+        std::cout << "error code: " << result.value() << " - " << result.message() << std::endl;
+        return 1;
+    }
+
+    auto batch = audio_batch_obj(output_sample_rate_hz, output_format, output_ch_layout);
+    std::vector<audio_batch_job_result> results;
+    auto summary = batch.run(jobs, results);
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (results[i].error != audio_demuxer_errc::SUCCESS) {
+            std::cout << jobs[i].input << " error code: " << results[i].error.value()
+                      << " - " << results[i].error.message() << std::endl;
+        }
+    }
+    std::cout << "files: " << summary.nb_files << " (failed: " << summary.nb_failed << ")" << std::endl;
+    std::cout << "wall time: " << summary.wall_seconds << " s" << std::endl;
+    std::cout << "files/s: " << summary.files_per_second() << std::endl;
+    std::cout << "audio-seconds/s: " << summary.audio_seconds_per_second() << std::endl;
+
+    return summary.nb_failed == 0 ? 0 : 1;
+}
+
+int run_stream(const std::filesystem::path &input,
+               const std::filesystem::path &output_file,
+               int output_sample_rate_hz,
+               AVSampleFormat output_format,
+               int64_t output_ch_layout) {
+    std::ofstream out_stream(output_file, std::ios::binary | std::ios::trunc);
+    if (!out_stream.is_open()) {
+        std::cout << "could not open " << output_file << std::endl;
+        return 1;
+    }
+
+    // every chunk is flushed so a reader of the output sees it right away
+    audio_callback_sink_obj sink([&](std::span<const std::span<const uint8_t> > planes, int) {
+        for (auto & item : planes) {
+            out_stream.write(reinterpret_cast<const char *>(item.data()), static_cast<std::streamsize>(item.size()));
+        }
+        out_stream.flush();
+        return out_stream.good() ? std::error_code() : audio_demuxer_errc::WRITE_OUTPUT_ERR;
+    });
+
+    auto src_filename = input;
+    auto transcoder = audio_demuxer_obj(src_filename, output_sample_rate_hz, output_format, output_ch_layout);
+    audio_streaming_options streaming_options;
+    streaming_options.enabled = true;
+    transcoder.set_streaming_options(streaming_options);
+    auto result = transcoder.convert(sink);
+    std::cout << "error code: " << result.value() << " - " << result.message() << std::endl;
+
+    auto &latency = transcoder.get_latency_histogram();
+    std::cout << "chunks: " << latency.get_count() << std::endl;
+    std::cout << "latency p50/p99/max: " << latency.get_percentile_ns(50) / 1000 << " / "
+              << latency.get_percentile_ns(99) / 1000 << " / " << latency.get_max_ns() / 1000 << " us" << std::endl;
+
+    return result == audio_demuxer_errc::SUCCESS ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
     std::cout << "___audio_transcoder___" << std::endl;
 
     std::filesystem::path src_filename = "tmam_proxy.mp4";
@@ -12,6 +80,15 @@ int main() {
     AVSampleFormat output_format  = AV_SAMPLE_FMT_S16;
     int64_t output_ch_layout = AV_CH_LAYOUT_MONO;
 
+    // audio_transcoder --batch <manifest>
+    if (argc == 3 && std::string(argv[1]) == "--batch") {
+        return run_batch(argv[2], output_sample_rate_hz, output_format, output_ch_layout);
+    }
+    // audio_transcoder --stream <live input, e.g. a fifo> <output>
+    if (argc == 4 && std::string(argv[1]) == "--stream") {
+        return run_stream(argv[2], argv[3], output_sample_rate_hz, output_format, output_ch_layout);
+    }
+
     auto transcoder = audio_demuxer_obj(src_filename,
                                         output_sample_rate_hz,
                                         output_format,
@@ -20,4 +97,4 @@ int main() {
     std::cout << "error code: " << result.value() << " - " << result.message() << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// bounded lock-free single producer / single consumer queue
+// capacity is rounded up to a power of two, storage is allocated once
+// a side that found the queue empty / full can block in wait_until, pushes and
+// pops only touch the wait counter while somebody is blocked
+
+template<typename T>
+class spsc_queue final {
+public:
+    explicit spsc_queue(size_t min_capacity) :
+            mask(round_up_pow2(min_capacity) - 1),
+            slots(mask + 1),
+            head(0),
+            tail(0),
+            events(0),
+            waiters(0) {
+
+    }
+
+    // Disallow copying
+    spsc_queue(spsc_queue &other) = delete;
+    spsc_queue &operator=(spsc_queue &other) = delete;
+
+    // producer side, false when the queue is full
+    bool try_push(const T &item) {
+        auto current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slots[current_tail & mask] = item;
+        tail.store(current_tail + 1, std::memory_order_release);
+        signal();
+        return true;
+    }
+
+    // consumer side, false when the queue is empty
+    bool try_pop(T &item) {
+        auto current_head = head.load(std::memory_order_relaxed);
+        if (current_head == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[current_head & mask];
+        head.store(current_head + 1, std::memory_order_release);
+        signal();
+        return true;
+    }
+
+    // blocks until ready() holds, it is re-checked after every push, pop and wake
+    template<typename Predicate>
+    void wait_until(Predicate ready) {
+        waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (true) {
+            auto seen = events.load(std::memory_order_acquire);
+            if (ready()) {
+                break ;
+            }
+            events.wait(seen, std::memory_order_acquire);
+        }
+        waiters.fetch_sub(1);
+    }
+
+    // releases blocked waiters so they re-check, e.g. after an abort flag was set
+    void wake() {
+        events.fetch_add(1, std::memory_order_release);
+        events.notify_all();
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    size_t          mask;
+    std::vector<T>  slots;
+
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<std::uint32_t> events;
+    std::atomic<std::uint32_t> waiters;
+
+    // pairs with the fence in wait_until: either the waiter sees the new
+    // head / tail or this side sees the waiter
+    void signal() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            wake();
+        }
+    }
+
+    static size_t round_up_pow2(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+};